@@ -0,0 +1,273 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#ifdef ESP32
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#else
+// Arduino cores that define min and max as macros break the std headers
+#pragma push_macro("min")
+#pragma push_macro("max")
+#undef min
+#undef max
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#pragma pop_macro("min")
+#pragma pop_macro("max")
+#endif
+
+// Hands finished frames from the task decoding them to a task showing them, the next
+// frame is decoded while FastLED.show() still clocks out the last one. Frames go through
+// three buffers swapped with a single atomic exchange, neither task waits for the other.
+// A frame the show task hasn't picked up by the time the next one is presented is dropped,
+// the player's clock has moved past it already.
+// Tasks are FreeRTOS tasks pinned to a core on the ESP32 and std::threads on a host.
+
+#define FRAME_PIPELINE_CORE      0     // Core of the show task, loop() runs on core 1 [0]
+#define FRAME_PIPELINE_STACK     4096  // Stack of the show task in bytes [4096]
+#define FRAME_PIPELINE_PRIORITY  1     // Priority of the show task, same as loop() [1]
+#define FRAME_PIPELINE_FRESH     4     // Flag on the ready buffer, set until the show task takes it
+
+// Wakes a task waiting for it, a notify before the wait isn't lost
+class TaskSignal{
+
+public:
+
+    TaskSignal();
+    ~TaskSignal();
+    void notify();
+    void wait();
+
+#ifdef ESP32
+    SemaphoreHandle_t semaphore;
+#else
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool notified = false;
+#endif
+};
+
+typedef void (*task_function)(void * user);
+
+// Runs function(user) on a task of its own, core is ignored on a host
+class Task{
+
+public:
+
+    bool start(const char * name, task_function function, void * user, int core, uint32_t stackSize, int priority);
+    void join();
+    static void run(void * task);
+
+    task_function function = NULL;
+    void * user = NULL;
+    bool started = false;
+#ifdef ESP32
+    TaskSignal finished;
+#else
+    std::thread thread;
+#endif
+};
+
+// Shows a frame of frameSize bytes, called on the show task
+typedef void (*show_callback)(void * user, const uint8_t * frame);
+
+class FramePipeline{
+
+public:
+
+    FramePipeline(size_t frameSize);
+    ~FramePipeline();
+    void setShowCallback(show_callback show, void * user);
+    bool begin(int core = FRAME_PIPELINE_CORE);
+    void end();
+    void present(const void * frame);
+    bool isFramePending();
+    unsigned long getShownFrames();
+    unsigned long getDroppedFrames();
+    static void showTask(void * user);
+    void showFrames();
+
+    size_t frameSize;
+    uint8_t * buffers = NULL;
+    show_callback show = NULL;
+    void * showUser = NULL;
+
+    // back is written by the presenting task and front read by the show task, ready is
+    // the one in between plus FRAME_PIPELINE_FRESH when it holds a frame not shown yet
+    int back = 0;
+    int front = 2;
+    std::atomic<int> ready;
+    std::atomic<bool> running;
+    std::atomic<unsigned long> shownFrames;
+    unsigned long droppedFrames = 0;
+
+    TaskSignal frameSignal;
+    Task task;
+};
+
+TaskSignal::TaskSignal(){
+#ifdef ESP32
+  semaphore = xSemaphoreCreateBinary();
+#endif
+}
+
+TaskSignal::~TaskSignal(){
+#ifdef ESP32
+  vSemaphoreDelete(semaphore);
+#endif
+}
+
+void TaskSignal::notify(){
+#ifdef ESP32
+  xSemaphoreGive(semaphore);
+#else
+  std::lock_guard<std::mutex> lock(mutex);
+  notified = true;
+  condition.notify_one();
+#endif
+}
+
+void TaskSignal::wait(){
+#ifdef ESP32
+  xSemaphoreTake(semaphore, portMAX_DELAY);
+#else
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [this]{ return notified; });
+  notified = false;
+#endif
+}
+
+bool Task::start(const char * name, task_function function, void * user, int core, uint32_t stackSize, int priority){
+  this->function = function;
+  this->user = user;
+#ifdef ESP32
+  started = xTaskCreatePinnedToCore(run, name, stackSize, this, priority, NULL, core) == pdPASS;
+#else
+  thread = std::thread(run, this);
+  started = true;
+#endif
+  if(!started){
+    Serial.printf("Can not start task %s\n", name);
+  }
+  return started;
+}
+
+// Wait until function returned
+void Task::join(){
+  if(!started){
+    return;
+  }
+#ifdef ESP32
+  finished.wait();
+#else
+  thread.join();
+#endif
+  started = false;
+}
+
+void Task::run(void * task){
+  Task * self = (Task *)task;
+  self->function(self->user);
+#ifdef ESP32
+  // FreeRTOS tasks must not return
+  self->finished.notify();
+  vTaskDelete(NULL);
+#endif
+}
+
+FramePipeline::FramePipeline(size_t frameSize) : frameSize(frameSize), ready(1), running(false), shownFrames(0){
+}
+
+FramePipeline::~FramePipeline(){
+  end();
+}
+
+void FramePipeline::setShowCallback(show_callback show, void * user){
+  this->show = show;
+  showUser = user;
+}
+
+// Start the show task, without it present() shows frames right away
+bool FramePipeline::begin(int core){
+  end();
+  buffers = (uint8_t *)calloc(3, frameSize);
+  if(!buffers){
+    Serial.println("Not enough memory for the frame pipeline");
+    return false;
+  }
+  back = 0;
+  ready = 1;
+  front = 2;
+  running = true;
+  if(!task.start("show", showTask, this, core, FRAME_PIPELINE_STACK, FRAME_PIPELINE_PRIORITY)){
+    running = false;
+    free(buffers);
+    buffers = NULL;
+    return false;
+  }
+  return true;
+}
+
+// Stop the show task once it showed the frame it's on
+void FramePipeline::end(){
+  if(!running){
+    return;
+  }
+  running = false;
+  frameSignal.notify();
+  task.join();
+  free(buffers);
+  buffers = NULL;
+}
+
+// Hand a frame to the show task, a copy is taken and the caller can draw the next one
+void FramePipeline::present(const void * frame){
+  if(!running){
+    if(show){
+      show(showUser, (const uint8_t *)frame);
+      shownFrames++;
+    }
+    return;
+  }
+  memcpy(&buffers[back * frameSize], frame, frameSize);
+  int previous = ready.exchange(back | FRAME_PIPELINE_FRESH);
+  back = previous & ~FRAME_PIPELINE_FRESH;
+  if(previous & FRAME_PIPELINE_FRESH){
+    droppedFrames++;
+  }
+  frameSignal.notify();
+}
+
+// A presented frame the show task hasn't started showing yet
+bool FramePipeline::isFramePending(){
+  return ready.load() & FRAME_PIPELINE_FRESH;
+}
+
+unsigned long FramePipeline::getShownFrames(){
+  return shownFrames.load();
+}
+
+// Frames replaced by the next one before they were shown
+unsigned long FramePipeline::getDroppedFrames(){
+  return droppedFrames;
+}
+
+void FramePipeline::showTask(void * user){
+  ((FramePipeline *)user)->showFrames();
+}
+
+void FramePipeline::showFrames(){
+  while(running){
+    frameSignal.wait();
+    while(ready.load() & FRAME_PIPELINE_FRESH){
+      front = ready.exchange(front) & ~FRAME_PIPELINE_FRESH;
+      show(showUser, &buffers[front * frameSize]);
+      shownFrames++;
+    }
+  }
+}
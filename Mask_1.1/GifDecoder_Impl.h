@@ -75,6 +75,8 @@
 #define ERROR_FILENOTGIF           -2
 #define ERROR_BADGIFFORMAT         -3
 #define ERROR_UNKNOWNCONTROLEXT    -4
+#define ERROR_BADFRAME             -5
+#define ERROR_OUTOFMEMORY          -6
 
 #define GIFHDRTAGNORM   "GIF87a"  // tag in valid GIF file
 #define GIFHDRTAGNORM1  "GIF89a"  // tag in valid GIF file
@@ -87,6 +89,10 @@
 
 #define NO_TRANSPARENT_INDEX -1
 
+// scaleIndex[] values besides a palette index
+#define SCALE_INDEX_NONE    -1
+#define SCALE_INDEX_MIXED   -2
+
 // Disposal methods
 #define DISPOSAL_NONE       0
 #define DISPOSAL_LEAVE      1
@@ -94,69 +100,413 @@
 #define DISPOSAL_RESTORE    3
 
 
+GifClock::GifClock() {
+    timeCallback = NULL;
+    timeCallbackUser = NULL;
+    running = false;
+    due_ms = 0;
+    speed = 256;
+    remainder = 0;
+    minFrameTime_ms = 0;
+}
+
+void GifClock::setTimeCallback(time_callback f, void *user) {
+    timeCallback = f;
+    timeCallbackUser = user;
+}
+
+unsigned long GifClock::now() {
+    return timeCallback ? (*timeCallback)(timeCallbackUser) : millis();
+}
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setStartDrawingCallback(callback f) {
+void GifClock::setSpeed(float speed) {
+    if (speed < 0.25f) {
+        speed = 0.25f;
+    }
+    if (speed > 4.0f) {
+        speed = 4.0f;
+    }
+    this->speed = (unsigned int)(speed * 256 + 0.5f);
+    remainder = 0;
+}
+
+float GifClock::getSpeed() {
+    return speed / 256.0f;
+}
+
+void GifClock::setMinFrameTime(unsigned long ms) {
+    minFrameTime_ms = ms;
+}
+
+void GifClock::reset() {
+    running = false;
+    remainder = 0;
+}
+
+// Differences instead of comparisons keep working when millis() wraps around
+bool GifClock::isDue() {
+    return !running || ((long)(now() - due_ms) >= 0);
+}
+
+unsigned long GifClock::getTimeToNext() {
+    if (!running) {
+        return 0;
+    }
+    long time = (long)(due_ms - now());
+    return (time > 0) ? time : 0;
+}
+
+unsigned long GifClock::getLateness() {
+    if (!running) {
+        return 0;
+    }
+    long time = (long)(now() - due_ms);
+    return (time > 0) ? time : 0;
+}
+
+bool GifClock::isOver(int frameDelay) {
+    unsigned long r = remainder;
+    return running && ((long)(now() - (due_ms + frameTime(frameDelay, r))) >= 0);
+}
+
+void GifClock::advance(int frameDelay) {
+    unsigned long time = frameTime(frameDelay, remainder);
+    unsigned long t = now();
+    if (!running) {
+        due_ms = t;
+        running = true;
+    }
+    due_ms += time;
+
+    // Too far behind to catch up, carry on from now
+    if ((long)(t - due_ms) > GIF_MAX_LATENESS) {
+        due_ms = t;
+    }
+}
+
+// Time a frame is up for at the current speed, the part of a ms it's rounded down
+// by is carried over to the next frame in remainder
+unsigned long GifClock::frameTime(int frameDelay, unsigned long &remainder) {
+    unsigned long scaled = 10UL * 256 * frameDelay + remainder;
+    unsigned long time = scaled / speed;
+    remainder = scaled % speed;
+    if (time < minFrameTime_ms) {
+        time = minFrameTime_ms;
+        remainder = 0;
+    }
+    return time;
+}
+
+GifDecoder::GifDecoder(int maxWidth, int maxHeight) {
+    this->maxWidth = maxWidth;
+    this->maxHeight = maxHeight;
+    canvasWidth = maxWidth;
+    canvasHeight = maxHeight;
+
+    arena = NULL;
+    arenaSize = 0;
+    arenaNeeded = 0;
+    arenaReady = false;
+    imageData = NULL;
+    imageDataBU = NULL;
+    emptyPixels = emptyPixelsBU = NULL;
+    prevBackgroundEmpty = false;
+    interlacedRows = NULL;
+    streamRows = false;
+    fillCanvas = false;
+    rowBuffer = NULL;
+    lzwTableSize = 0;
+    stack = suffix = NULL;
+    prefix = length = NULL;
+    scaleChunk = NULL;
+    scaleSum = NULL;
+    scaleOpaque = scaleTransparent = NULL;
+    scaleIndex = NULL;
+    localPalette = NULL;
+    globalColorCount = 0;
+    loopCount = 0;
+    loopsCompleted = 0;
+    // Indices past the end of a short color table draw black, not whatever was in memory
+    memset(globalPalette, 0, sizeof(globalPalette));
+    palette = globalPalette;
+    colorCount = 0;
+
+    callbackUser = NULL;
+    screenClearCallback = NULL;
+    updateScreenCallback = NULL;
+    drawPixelCallback = NULL;
+    drawRowCallback = NULL;
+    paletteCallback = NULL;
+    startDrawingCallback = NULL;
+    fileSeekCallback = NULL;
+    filePositionCallback = NULL;
+    fileReadCallback = NULL;
+    fileReadBlockCallback = NULL;
+    fileData = NULL;
+    fileDataSize = 0;
+    readData = readBuffer;
+
+    frameIndex = NULL;
+    frameIndexSize = 0;
+    frameCount = 0;
+    frameIndexComplete = false;
+    frameSnapshots = NULL;
+    frameSnapshotCount = 0;
+    frameSnapshotInterval = 1;
+    scaleMode = GIF_SCALE_NONE;
+    silentFrame = false;
+    redrawCanvas = false;
+    canvasDisposed = false;
+    framePending = false;
+    clock = &ownClock;
+    dropLateFrames = true;
+    dropping = false;
+    frameDropped = false;
+    droppedFrames = 0;
+    droppedX = droppedY = droppedWidth = droppedHeight = 0;
+    dirtyX = dirtyY = dirtyWidth = dirtyHeight = 0;
+#if GIF_STATS
+    stats = NULL;
+#endif
+}
+
+// The arena should be 4 byte aligned like malloc() memory, takes effect with the next startDecoding()
+void GifDecoder::setArena(void *arena, size_t size) {
+    this->arena = (uint8_t *)arena;
+    arenaSize = arena ? size : 0;
+    arenaReady = false;
+}
+
+size_t GifDecoder::getArenaNeeded() {
+    return arenaNeeded;
+}
+
+void GifDecoder::setCallbackUser(void *user) {
+    callbackUser = user;
+}
+
+void GifDecoder::setStartDrawingCallback(callback f) {
     startDrawingCallback = f;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setUpdateScreenCallback(callback f) {
+void GifDecoder::setUpdateScreenCallback(callback f) {
     updateScreenCallback = f;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setDrawPixelCallback(pixel_callback f) {
+void GifDecoder::setDrawPixelCallback(pixel_callback f) {
     drawPixelCallback = f;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setScreenClearCallback(callback f) {
+void GifDecoder::setDrawRowCallback(row_callback f) {
+    drawRowCallback = f;
+}
+
+void GifDecoder::setPaletteCallback(palette_callback f) {
+    paletteCallback = f;
+}
+
+// Takes effect with the next startDecoding()
+void GifDecoder::setScaleMode(int mode) {
+    scaleMode = mode;
+}
+
+void GifDecoder::setScreenClearCallback(callback f) {
     screenClearCallback = f;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setFileSeekCallback(file_seek_callback f) {
+void GifDecoder::setFileSeekCallback(file_seek_callback f) {
     fileSeekCallback = f;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setFilePositionCallback(file_position_callback f) {
+void GifDecoder::setFilePositionCallback(file_position_callback f) {
     filePositionCallback = f;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setFileReadCallback(file_read_callback f) {
+void GifDecoder::setFileReadCallback(file_read_callback f) {
     fileReadCallback = f;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::setFileReadBlockCallback(file_read_block_callback f) {
+void GifDecoder::setFileReadBlockCallback(file_read_block_callback f) {
     fileReadBlockCallback = f;
 }
 
+void GifDecoder::setFileData(const void *data, size_t size) {
+    fileData = (const uint8_t *)data;
+    fileDataSize = data ? size : 0;
+}
+
+int GifDecoder::getFileCallbacksPerFrame() {
+    return fileCallbacksLastFrame;
+}
+
+void GifDecoder::setFrameIndex(gif_frame_info *frames, int maxFrames, int knownFrames) {
+    frameIndex = frames;
+    frameIndexSize = maxFrames;
+    frameCount = (frames != NULL) ? min(knownFrames, maxFrames) : 0;
+    frameIndexComplete = (frameCount > 0);
+}
+
+void GifDecoder::setFrameSnapshots(FrameSnapshot *snapshots, int count, int interval) {
+    frameSnapshots = snapshots;
+    frameSnapshotCount = count;
+    frameSnapshotInterval = (interval > 0) ? interval : 1;
+
+    for (int i = 0; i < frameSnapshotCount; i++) {
+        frameSnapshots[i].frame = -1;
+    }
+}
+
+int GifDecoder::getFrameCount() {
+    return frameCount;
+}
+
+bool GifDecoder::isFrameIndexComplete() {
+    return frameIndexComplete;
+}
+
+int GifDecoder::getCurrentFrame() {
+    return currentFrame;
+}
+
+int GifDecoder::getFrameDelay() {
+    return frameDelay;
+}
+
+int GifDecoder::getLoopCount() {
+    return loopCount;
+}
+
+int GifDecoder::getLoopsCompleted() {
+    return loopsCompleted;
+}
+
+void GifDecoder::getDirtyRect(int &x, int &y, int &width, int &height) {
+    x = dirtyX;
+    y = dirtyY;
+    width = dirtyWidth;
+    height = dirtyHeight;
+}
+
+// Grow a rectangle to take in another one, either may be empty
+void GifDecoder::uniteRect(int &x, int &y, int &width, int &height, int x2, int y2, int width2, int height2) {
+    if ((width2 <= 0) || (height2 <= 0)) {
+        return;
+    }
+    if ((width <= 0) || (height <= 0)) {
+        x = x2;
+        y = y2;
+        width = width2;
+        height = height2;
+        return;
+    }
+    int right = (x + width > x2 + width2) ? x + width : x2 + width2;
+    int bottom = (y + height > y2 + height2) ? y + height : y2 + height2;
+    x = min(x, x2);
+    y = min(y, y2);
+    width = right - x;
+    height = bottom - y;
+}
+
+bool GifDecoder::isFramePending() {
+    return framePending;
+}
+
+unsigned long GifDecoder::getTimeToNextFrame() {
+    return clock->getTimeToNext();
+}
+
+void GifDecoder::setClock(GifClock *clock) {
+    this->clock = clock ? clock : &ownClock;
+}
+
+GifClock *GifDecoder::getClock() {
+    return clock;
+}
+
+void GifDecoder::setDropLateFrames(bool drop) {
+    dropLateFrames = drop;
+}
+
+int GifDecoder::getDroppedFrames() {
+    return droppedFrames;
+}
+
+#if GIF_STATS
+void GifDecoder::setStats(GifStats *stats) {
+    this->stats = stats;
+}
+#endif
+
+// Drop the read-ahead buffer contents, the next read refills from position 0
+// A gif in memory is buffered as a whole
+void GifDecoder::resetReadBuffer() {
+    readData = fileData ? fileData : readBuffer;
+    readBufferFilePos = 0;
+    readBufferLen = fileDataSize;
+    readBufferPos = 0;
+}
+
+// Refill the read-ahead buffer with the data following its current contents
+bool GifDecoder::fillReadBuffer() {
+    // nothing follows a gif in memory
+    if (fileData) {
+        return false;
+    }
+
+    readBufferFilePos += readBufferLen;
+    readBufferPos = 0;
+
+    fileCallbacks++;
+    readBufferLen = fileReadBlockCallback(callbackUser, readBuffer, sizeof(readBuffer));
+    if (readBufferLen < 0) {
+        readBufferLen = 0;
+    }
+    return readBufferLen > 0;
+}
+
+// Current position in the file as seen by the parser
+unsigned long GifDecoder::streamPosition() {
+    return readBufferFilePos + readBufferPos;
+}
+
+// Move the read stream, only calls fileSeekCallback() if position isn't buffered
+bool GifDecoder::seekStream(unsigned long position) {
+    if ((position >= readBufferFilePos) && (position <= readBufferFilePos + readBufferLen)) {
+        readBufferPos = position - readBufferFilePos;
+        return true;
+    }
+    if (fileData) {
+        readBufferPos = readBufferLen;
+        return false;
+    }
+
+    readBufferFilePos = position;
+    readBufferLen = 0;
+    readBufferPos = 0;
+
+    fileCallbacks++;
+    return fileSeekCallback(callbackUser, position);
+}
+
 // Backup the read stream by n bytes
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::backUpStream(int n) {
-    fileSeekCallback(filePositionCallback() - n);
+void GifDecoder::backUpStream(int n) {
+    seekStream(streamPosition() - n);
 }
 
 // Read a file byte
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::readByte() {
+int GifDecoder::readByte() {
 
-    int b = fileReadCallback();
-    if (b == -1) {
+    if ((readBufferPos == readBufferLen) && !fillReadBuffer()) {
 #if GIFDEBUG == 1
         Serial.println("Read error or EOF occurred");
 #endif
+        return -1;
     }
-    return b;
+    return readData[readBufferPos++];
 }
 
 // Read a file word
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::readWord() {
+int GifDecoder::readWord() {
 
     int b0 = readByte();
     int b1 = readByte();
@@ -164,24 +514,31 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::readWord() {
 }
 
 // Read the specified number of bytes into the specified buffer
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::readIntoBuffer(void *buffer, int numberOfBytes) {
+int GifDecoder::readIntoBuffer(void *buffer, int numberOfBytes) {
 
-    int result = fileReadBlockCallback(buffer, numberOfBytes);
-    if (result == -1) {
-        Serial.println("Read error or EOF occurred");
+    uint8_t *dst = (uint8_t *)buffer;
+    int result = 0;
+
+    while (result < numberOfBytes) {
+        if ((readBufferPos == readBufferLen) && !fillReadBuffer()) {
+            Serial.println("Read error or EOF occurred");
+            break;
+        }
+        int count = min(numberOfBytes - result, readBufferLen - readBufferPos);
+        memcpy(dst + result, readData + readBufferPos, count);
+        readBufferPos += count;
+        result += count;
     }
     return result;
 }
 
 // Fill a portion of imageData buffer with a color index
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::fillImageDataRect(uint8_t colorIndex, int x, int y, int width, int height) {
+void GifDecoder::fillImageDataRect(uint8_t colorIndex, int x, int y, int width, int height) {
 
     int yOffset;
 
     for (int yy = y; yy < height + y; yy++) {
-        yOffset = yy * maxGifWidth;
+        yOffset = yy * canvasWidth;
         for (int xx = x; xx < width + x; xx++) {
             imageData[yOffset + xx] = colorIndex;
         }
@@ -189,20 +546,18 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::fillImageDataRect(uint8_
 }
 
 // Fill entire imageData buffer with a color index
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::fillImageData(uint8_t colorIndex) {
+void GifDecoder::fillImageData(uint8_t colorIndex) {
 
-    memset(imageData, colorIndex, sizeof(imageData));
+    memset(imageData, colorIndex, canvasWidth * canvasHeight);
 }
 
 // Copy image data in rect from a src to a dst
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::copyImageDataRect(uint8_t *dst, uint8_t *src, int x, int y, int width, int height) {
+void GifDecoder::copyImageDataRect(uint8_t *dst, uint8_t *src, int x, int y, int width, int height) {
 
     int yOffset, offset;
 
     for (int yy = y; yy < height + y; yy++) {
-        yOffset = yy * maxGifWidth;
+        yOffset = yy * canvasWidth;
         for (int xx = x; xx < width + x; xx++) {
             offset = yOffset + xx;
             dst[offset] = src[offset];
@@ -210,9 +565,55 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::copyImageDataRect(uint8_
     }
 }
 
+// Whether canvas pixel i is empty, see emptyPixels
+bool GifDecoder::isEmptyPixel(int i) {
+    return (emptyPixels[i >> 3] >> (i & 7)) & 1;
+}
+
+// Mark a rect of the pixels in bits empty or not
+void GifDecoder::setEmptyRect(uint8_t *bits, bool empty, int x, int y, int width, int height) {
+
+    for (int yy = y; yy < height + y; yy++) {
+        for (int i = (yy * canvasWidth) + x; i < (yy * canvasWidth) + x + width; i++) {
+            if (empty) {
+                bits[i >> 3] |= 1 << (i & 7);
+            }
+            else {
+                bits[i >> 3] &= ~(1 << (i & 7));
+            }
+        }
+    }
+}
+
+// Copy the empty bits in rect from src to dst
+void GifDecoder::copyEmptyRect(uint8_t *dst, uint8_t *src, int x, int y, int width, int height) {
+
+    for (int yy = y; yy < height + y; yy++) {
+        for (int i = (yy * canvasWidth) + x; i < (yy * canvasWidth) + x + width; i++) {
+            uint8_t bit = 1 << (i & 7);
+            dst[i >> 3] = (dst[i >> 3] & ~bit) | (src[i >> 3] & bit);
+        }
+    }
+}
+
+// Pixels of the frame just decoded are empty where it is transparent
+void GifDecoder::markEmptyPixels(int x, int y, int width, int height) {
+
+    for (int yy = y; yy < height + y; yy++) {
+        for (int i = (yy * canvasWidth) + x; i < (yy * canvasWidth) + x + width; i++) {
+            uint8_t bit = 1 << (i & 7);
+            if (imageData[i] == transparentColorIndex) {
+                emptyPixels[i >> 3] |= bit;
+            }
+            else {
+                emptyPixels[i >> 3] &= ~bit;
+            }
+        }
+    }
+}
+
 // Make sure the file is a Gif file
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-bool GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGifHeader() {
+bool GifDecoder::parseGifHeader() {
 
     char buffer[10];
 
@@ -227,8 +628,7 @@ bool GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGifHeader() {
 }
 
 // Parse the logical screen descriptor
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseLogicalScreenDescriptor() {
+void GifDecoder::parseLogicalScreenDescriptor() {
 
     lsdWidth = readWord();
     lsdHeight = readWord();
@@ -251,8 +651,7 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseLogicalScreenDescri
 }
 
 // Parse the global color table
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGlobalColorTable() {
+void GifDecoder::parseGlobalColorTable() {
 
     // Does a global color table exist?
     if (lsdPackedField & COLORTBLFLAG) {
@@ -267,34 +666,51 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGlobalColorTable()
 #endif
         // Read color values into the palette array
         int colorTableBytes = sizeof(rgb_24) * colorCount;
-        readIntoBuffer(palette, colorTableBytes);
+        readIntoBuffer(globalPalette, colorTableBytes);
+        globalColorCount = colorCount;
+
+        usePalette(globalPalette, globalColorCount, true);
+    }
+}
+
+// Draw with another color table, or with the one in use after loading it anew
+void GifDecoder::usePalette(rgb_24 *colors, int count, bool loaded) {
+    if ((colors == palette) && !loaded) {
+        return;
+    }
+    palette = colors;
+    colorCount = count;
+
+    if(paletteCallback)
+        (*paletteCallback)(callbackUser, palette, colorCount);
+}
+
+// Skip a chain of data sub-blocks up to and including the block terminator
+void GifDecoder::skipDataSubBlocks() {
+
+    int len = readByte();
+    while (len > 0) {
+        seekStream(streamPosition() + len);
+        len = readByte();
     }
 }
 
 // Parse plain text extension and dispose of it
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parsePlainTextExtension() {
+void GifDecoder::parsePlainTextExtension() {
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_PLAIN_TEXT_EXT == 1
     Serial.println("\nProcessing Plain Text Extension");
 #endif
-    // Read plain text header length
+    // Skip plain text header
     uint8_t len = readByte();
+    seekStream(streamPosition() + len);
 
-    // Consume plain text header data
-    readIntoBuffer(tempBuffer, len);
-
-    // Consume the plain text data in blocks
-    len = readByte();
-    while (len != 0) {
-        readIntoBuffer(tempBuffer, len);
-        len = readByte();
-    }
+    // Skip the plain text data blocks
+    skipDataSubBlocks();
 }
 
 // Parse a graphic control extension
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGraphicControlExtension() {
+void GifDecoder::parseGraphicControlExtension() {
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_GRAPHIC_CONTROL_EXT == 1
     Serial.println("\nProcessing Graphic Control Extension");
@@ -333,69 +749,56 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGraphicControlExten
 }
 
 // Parse application extension
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseApplicationExtension() {
-
-    memset(tempBuffer, 0, sizeof(tempBuffer));
+void GifDecoder::parseApplicationExtension() {
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_APP_EXT == 1
     Serial.println("\nProcessing Application Extension");
 #endif
 
-    // Read block length
+    // Only the NETSCAPE2.0 loop count is of any use, all other app data is skipped
+    char identifier[11];
     uint8_t len = readByte();
+    if (len != sizeof(identifier)) {
+        seekStream(streamPosition() + len);
+    }
+    else {
+        readIntoBuffer(identifier, len);
+        if ((memcmp(identifier, "NETSCAPE2.0", len) == 0) || (memcmp(identifier, "ANIMEXTS1.0", len) == 0)) {
+            // Sub-block 1 holds the loop count
+            len = readByte();
+            if (len == 0) {
+                return;
+            }
+            unsigned long next = streamPosition() + len;
+            if ((len >= 3) && (readByte() == 1)) {
+                loopCount = readWord();
+            }
+            seekStream(next);
+        }
+    }
 
-    // Read app data
-    readIntoBuffer(tempBuffer, len);
+    // Skip any additional app data
+    skipDataSubBlocks();
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_APP_EXT == 1
-    // Conditionally display the application extension string
-    if (strlen(tempBuffer) != 0) {
-        Serial.print("Application Extension: ");
-        Serial.println(tempBuffer);
-    }
+    Serial.print("Loop count: ");
+    Serial.println(loopCount);
 #endif
-
-    // Consume any additional app data
-    len = readByte();
-    while (len != 0) {
-        readIntoBuffer(tempBuffer, len);
-        len = readByte();
-    }
 }
 
 // Parse comment extension
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseCommentExtension() {
+void GifDecoder::parseCommentExtension() {
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_COMMENT_EXT == 1
     Serial.println("\nProcessing Comment Extension");
 #endif
 
-    // Read block length
-    uint8_t len = readByte();
-    while (len != 0) {
-        // Clear buffer
-        memset(tempBuffer, 0, sizeof(tempBuffer));
-
-        // Read len bytes into buffer
-        readIntoBuffer(tempBuffer, len);
-
-#if GIFDEBUG == 1 && DEBUG_PROCESSING_COMMENT_EXT == 1
-        // Display the comment extension string
-        if (strlen(tempBuffer) != 0) {
-            Serial.print("Comment Extension: ");
-            Serial.println(tempBuffer);
-        }
-#endif
-        // Read the new block length
-        len = readByte();
-    }
+    // Comments are never displayed, skip them
+    skipDataSubBlocks();
 }
 
 // Parse file terminator
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGIFFileTerminator() {
+int GifDecoder::parseGIFFileTerminator() {
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_FILE_TERM == 1
     Serial.println("\nProcessing file terminator");
@@ -416,9 +819,267 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseGIFFileTerminator()
     }
 }
 
+// Decoder state before the first frame
+void GifDecoder::resetDecoderState() {
+    keyFrame = true;
+    prevDisposalMethod = DISPOSAL_NONE;
+    transparentColorIndex = NO_TRANSPARENT_INDEX;
+    currentFrame = -1;
+}
+
+// Walk through all blocks of the file once to find out what its buffers have to hold
+int GifDecoder::scanFrames() {
+    unsigned long start = streamPosition();
+    hasRestoreFrames = false;
+    needsCanvas = false;
+    mixedTransparency = false;
+    hasLocalColorTables = false;
+    hasInterlacedFrames = false;
+    loopCount = 0;
+    maxFramePixels = 0;
+    maxFrameWidth = 0;
+    maxLzwCodeSize = 0;
+    fileFrameCount = 0;
+    fileDuration_ms = 0;
+    // Like frameDelay a delay holds until the next graphic control extension
+    int delay = 0;
+    // Transparent index of the next frame and of the ones before it
+    int transparentIndex = NO_TRANSPARENT_INDEX;
+    int firstTransparentIndex = NO_TRANSPARENT_INDEX;
+
+    for (;;) {
+        int b = readByte();
+        if (b == 0x2c) {
+            // Image descriptor, local color table and LZW code size
+            readWord();
+            readWord();
+            long width = readWord();
+            long height = readWord();
+            int packedBits = readByte();
+            if (packedBits & INTERLACEFLAG) {
+                hasInterlacedFrames = true;
+            }
+            if (packedBits & COLORTBLFLAG) {
+                hasLocalColorTables = true;
+                seekStream(streamPosition() + sizeof(rgb_24) * (1 << ((packedBits & 7) + 1)));
+            }
+            int codeSize = readByte();
+            if (codeSize >= LZW_MAXBITS) {
+                Serial.println("Bad GIF file format - LZW code size");
+                return ERROR_BADGIFFORMAT;
+            }
+            if (codeSize > maxLzwCodeSize) {
+                maxLzwCodeSize = codeSize;
+            }
+            // Empty rows still take a code each
+            if ((width * height) + height > maxFramePixels) {
+                maxFramePixels = (width * height) + height;
+            }
+            if (width > maxFrameWidth) {
+                maxFrameWidth = width;
+            }
+            if ((transparentIndex == NO_TRANSPARENT_INDEX) || ((fileFrameCount > 0) && (transparentIndex != firstTransparentIndex))) {
+                mixedTransparency = true;
+            }
+            if (fileFrameCount == 0) {
+                firstTransparentIndex = transparentIndex;
+            }
+            transparentIndex = NO_TRANSPARENT_INDEX;
+            fileFrameCount++;
+            fileDuration_ms += 10UL * ((delay < 1) ? 1 : delay);
+            skipDataSubBlocks();
+        }
+        else if (b == 0x21) {
+            int label = readByte();
+            if (label == 0xff) {
+                parseApplicationExtension();
+                continue;
+            }
+            if (label == 0xf9) {
+                int len = readByte();
+                if (len <= 0) {
+                    continue;
+                }
+                unsigned long next = streamPosition() + len;
+                int packedBits = readByte();
+                if (len >= 3) {
+                    delay = readWord();
+                }
+                transparentIndex = ((len >= 4) && (packedBits & TRANSPARENTFLAG)) ? readByte() : NO_TRANSPARENT_INDEX;
+                int disposal = (packedBits >> 2) & 7;
+                if (disposal == DISPOSAL_RESTORE) {
+                    hasRestoreFrames = true;
+                }
+                if ((disposal == DISPOSAL_BACKGROUND) || (disposal == DISPOSAL_RESTORE) || (packedBits & TRANSPARENTFLAG)) {
+                    needsCanvas = true;
+                }
+                seekStream(next);
+            }
+            skipDataSubBlocks();
+        }
+        else {
+            // Trailer, or the end of what can be read
+            break;
+        }
+    }
+
+    seekStream(start);
+    return ERROR_NONE;
+}
+
+// Next 4 byte aligned part of the arena, NULL once the arena is used up
+void *GifDecoder::arenaAlloc(size_t &used, size_t size) {
+    size_t start = (used + 3) & ~(size_t)3;
+    used = start + size;
+    return (arena && (used <= arenaSize)) ? arena + start : NULL;
+}
+
+// Point all buffers the current file needs into the arena
+int GifDecoder::layoutArena() {
+    size_t used = 0;
+    int canvasSize = canvasWidth * canvasHeight;
+    int emptyBytes = (canvasSize + 7) / 8;
+
+    // Opaque frames that are never disposed of cover up what's below them for good,
+    // the screen holds everything the canvas would
+    streamRows = !needsCanvas && !isScaling();
+    fillCanvas = false;
+    if (streamRows) {
+        imageData = imageDataBU = NULL;
+        emptyPixels = emptyPixelsBU = NULL;
+        rowBuffer = (uint8_t *)arenaAlloc(used, (maxFrameWidth > canvasWidth) ? maxFrameWidth : canvasWidth);
+    }
+    else {
+        imageData = (uint8_t *)arenaAlloc(used, canvasSize);
+        imageDataBU = hasRestoreFrames ? (uint8_t *)arenaAlloc(used, canvasSize) : NULL;
+        emptyPixels = mixedTransparency ? (uint8_t *)arenaAlloc(used, emptyBytes) : NULL;
+        emptyPixelsBU = (mixedTransparency && hasRestoreFrames) ? (uint8_t *)arenaAlloc(used, emptyBytes) : NULL;
+        rowBuffer = (!isScaling() && (maxFrameWidth > canvasWidth)) ? (uint8_t *)arenaAlloc(used, maxFrameWidth) : NULL;
+    }
+    interlacedRows = (!streamRows && !isScaling() && hasInterlacedFrames) ? (uint16_t *)arenaAlloc(used, canvasHeight * sizeof(uint16_t)) : NULL;
+
+    // Root codes plus one code per pixel of the largest frame
+    lzwTableSize = min((1L << maxLzwCodeSize) + 2 + maxFramePixels, (long)LZW_SIZTABLE);
+    prefix = (uint16_t *)arenaAlloc(used, lzwTableSize * sizeof(uint16_t));
+    length = (uint16_t *)arenaAlloc(used, lzwTableSize * sizeof(uint16_t));
+    suffix = (uint8_t *)arenaAlloc(used, lzwTableSize);
+    stack = (uint8_t *)arenaAlloc(used, lzwTableSize);
+
+    // Local color tables of any size, the global one stays as it is for the frames after them
+    localPalette = hasLocalColorTables ? (rgb_24 *)arenaAlloc(used, sizeof(rgb_24) * 256) : NULL;
+
+    if (isScaling()) {
+        scaleSum = (uint32_t (*)[3])arenaAlloc(used, canvasWidth * sizeof(scaleSum[0]));
+        scaleOpaque = (uint16_t *)arenaAlloc(used, canvasWidth * sizeof(uint16_t));
+        scaleTransparent = (uint16_t *)arenaAlloc(used, canvasWidth * sizeof(uint16_t));
+        scaleIndex = (int16_t *)arenaAlloc(used, canvasWidth * sizeof(int16_t));
+        scaleChunk = (uint8_t *)arenaAlloc(used, GIF_SCALE_CHUNK_SIZE);
+    }
+    else {
+        scaleSum = NULL;
+        scaleOpaque = scaleTransparent = NULL;
+        scaleIndex = NULL;
+        scaleChunk = NULL;
+    }
+
+    // Snapshots belong to the previous file, there's nothing to keep without a canvas
+    for (int i = 0; i < frameSnapshotCount; i++) {
+        frameSnapshots[i].frame = -1;
+        frameSnapshots[i].imageData = !streamRows ? (uint8_t *)arenaAlloc(used, canvasSize) : NULL;
+        frameSnapshots[i].imageDataBU = (!streamRows && hasRestoreFrames) ? (uint8_t *)arenaAlloc(used, canvasSize) : NULL;
+        frameSnapshots[i].emptyPixels = (!streamRows && mixedTransparency) ? (uint8_t *)arenaAlloc(used, emptyBytes) : NULL;
+        frameSnapshots[i].emptyPixelsBU = (!streamRows && mixedTransparency && hasRestoreFrames) ? (uint8_t *)arenaAlloc(used, emptyBytes) : NULL;
+    }
+
+    arenaNeeded = used;
+    arenaReady = (used <= arenaSize);
+    if (!arenaReady) {
+        return ERROR_OUTOFMEMORY;
+    }
+    if (localPalette) {
+        memset(localPalette, 0, sizeof(rgb_24) * 256);
+    }
+    return ERROR_NONE;
+}
+
+// Keep a copy of the decoder state every frameSnapshotInterval frames
+void GifDecoder::saveFrameSnapshot() {
+
+    if (!frameSnapshots || (frameSnapshotCount < 1) || streamRows) {
+        return;
+    }
+
+    // Out of snapshots, keep every other one and double the interval
+    // Snapshots trade places so every one keeps image data of its own
+    while (currentFrame / frameSnapshotInterval >= frameSnapshotCount) {
+        for (int i = 1; i < frameSnapshotCount; i++) {
+            if (2 * i < frameSnapshotCount) {
+                FrameSnapshot kept = frameSnapshots[2 * i];
+                frameSnapshots[2 * i] = frameSnapshots[i];
+                frameSnapshots[i] = kept;
+            }
+            else {
+                frameSnapshots[i].frame = -1;
+            }
+        }
+        frameSnapshotInterval *= 2;
+    }
+
+    if (currentFrame % frameSnapshotInterval) {
+        return;
+    }
+
+    FrameSnapshot &snapshot = frameSnapshots[currentFrame / frameSnapshotInterval];
+    if (snapshot.frame == currentFrame) {
+        return;
+    }
+    snapshot.frame = currentFrame;
+    snapshot.prevDisposalMethod = prevDisposalMethod;
+    snapshot.prevBackgroundIndex = prevBackgroundIndex;
+    snapshot.prevBackgroundEmpty = prevBackgroundEmpty;
+    snapshot.rectX = rectX;
+    snapshot.rectY = rectY;
+    snapshot.rectWidth = rectWidth;
+    snapshot.rectHeight = rectHeight;
+    memcpy(snapshot.imageData, imageData, canvasWidth * canvasHeight);
+    if (imageDataBU) {
+        memcpy(snapshot.imageDataBU, imageDataBU, canvasWidth * canvasHeight);
+    }
+    if (emptyPixels) {
+        memcpy(snapshot.emptyPixels, emptyPixels, (canvasWidth * canvasHeight + 7) / 8);
+    }
+    if (emptyPixelsBU) {
+        memcpy(snapshot.emptyPixelsBU, emptyPixelsBU, (canvasWidth * canvasHeight + 7) / 8);
+    }
+}
+
+void GifDecoder::restoreFrameSnapshot(int slot) {
+
+    FrameSnapshot &snapshot = frameSnapshots[slot];
+    keyFrame = false;
+    transparentColorIndex = NO_TRANSPARENT_INDEX;
+    currentFrame = snapshot.frame;
+    prevDisposalMethod = snapshot.prevDisposalMethod;
+    prevBackgroundIndex = snapshot.prevBackgroundIndex;
+    prevBackgroundEmpty = snapshot.prevBackgroundEmpty;
+    rectX = snapshot.rectX;
+    rectY = snapshot.rectY;
+    rectWidth = snapshot.rectWidth;
+    rectHeight = snapshot.rectHeight;
+    memcpy(imageData, snapshot.imageData, canvasWidth * canvasHeight);
+    if (imageDataBU) {
+        memcpy(imageDataBU, snapshot.imageDataBU, canvasWidth * canvasHeight);
+    }
+    if (emptyPixels) {
+        memcpy(emptyPixels, snapshot.emptyPixels, (canvasWidth * canvasHeight + 7) / 8);
+    }
+    if (emptyPixelsBU) {
+        memcpy(emptyPixelsBU, snapshot.emptyPixelsBU, (canvasWidth * canvasHeight + 7) / 8);
+    }
+}
+
 // Parse table based image data
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
+void GifDecoder::parseTableBasedImage() {
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_TBI_DESC_START == 1
     Serial.println("\nProcessing Table Based Image Descriptor");
@@ -426,11 +1087,13 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
 
 #if GIFDEBUG == 1 && DEBUG_PARSING_DATA == 1
     Serial.println("File Position: ");
-    Serial.println(filePositionCallback());
+    Serial.println(streamPosition());
     Serial.println("File Size: ");
     //Serial.println(file.size());
 #endif
 
+    currentFrame++;
+
     // Parse image descriptor
     tbiImageX = readWord();
     tbiImageY = readWord();
@@ -451,6 +1114,17 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
     Serial.println(tbiPackedBits, HEX);
 #endif
 
+    // Scaled frames are decoded in logical screen coordinates,
+    // from here on tbiImageX/Y/Width/Height are the part of the canvas they cover
+    if (isScaling()) {
+        srcImageX = tbiImageX;
+        srcImageY = tbiImageY;
+        srcWidth = tbiWidth;
+        srcHeight = tbiHeight;
+        scaleRect(tbiImageX, tbiWidth, scaleWidth, canvasWidth);
+        scaleRect(tbiImageY, tbiHeight, scaleHeight, canvasHeight);
+    }
+
     // Is this image interlaced ?
     tbiInterlaced = ((tbiPackedBits & INTERLACEFLAG) != 0);
 
@@ -464,46 +1138,61 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
 
     if (localColorTable) {
         int colorBits = ((tbiPackedBits & 7) + 1);
-        colorCount = 1 << colorBits;
+        int localColorCount = 1 << colorBits;
 
 #if GIFDEBUG == 1 && DEBUG_PROCESSING_TBI_DESC_LOCAL_COLOR_TABLE == 1
         Serial.print("Local color table with ");
-        Serial.print(colorCount);
+        Serial.print(localColorCount);
         Serial.println(" colors present");
 #endif
-        // Read colors into palette
-        int colorTableBytes = sizeof(rgb_24) * colorCount;
-        readIntoBuffer(palette, colorTableBytes);
+        // Read colors into the local palette, the global one stays for later frames
+        int colorTableBytes = sizeof(rgb_24) * localColorCount;
+        readIntoBuffer(localPalette, colorTableBytes);
+        usePalette(localPalette, localColorCount, true);
     }
+    else {
+        usePalette(globalPalette, globalColorCount);
+    }
+
+    GIF_STATS_ENTER(stats, GIF_STAGE_COMPOSITE);
 
     // One time initialization of imageData before first frame
     if (keyFrame) {
-        if (transparentColorIndex == NO_TRANSPARENT_INDEX) {
+        if (streamRows) {
+            // No canvas
+        }
+        else if (transparentColorIndex == NO_TRANSPARENT_INDEX) {
             fillImageData(lsdBackgroundIndex);
         }
         else    {
             fillImageData(transparentColorIndex);
         }
+        if (emptyPixels) {
+            setEmptyRect(emptyPixels, transparentColorIndex != NO_TRANSPARENT_INDEX, 0, 0, canvasWidth, canvasHeight);
+        }
         keyFrame = false;
 
         rectX = 0;
         rectY = 0;
-        rectWidth = maxGifWidth;
-        rectHeight = maxGifHeight;
-    }
-    // Don't clear matrix screen for these disposal methods
-    if ((prevDisposalMethod != DISPOSAL_NONE) && (prevDisposalMethod != DISPOSAL_LEAVE)) {
-        if(screenClearCallback)
-            (*screenClearCallback)();
+        rectWidth = canvasWidth;
+        rectHeight = canvasHeight;
     }
+    // Disposal changes imageData outside of this frame, the whole canvas gets drawn
+    canvasDisposed = (prevDisposalMethod != DISPOSAL_NONE) && (prevDisposalMethod != DISPOSAL_LEAVE);
 
     // Process previous disposal method
     if (prevDisposalMethod == DISPOSAL_BACKGROUND) {
         // Fill portion of imageData with previous background color
         fillImageDataRect(prevBackgroundIndex, rectX, rectY, rectWidth, rectHeight);
+        if (emptyPixels) {
+            setEmptyRect(emptyPixels, prevBackgroundEmpty, rectX, rectY, rectWidth, rectHeight);
+        }
     }
     else if (prevDisposalMethod == DISPOSAL_RESTORE) {
         copyImageDataRect(imageData, imageDataBU, rectX, rectY, rectWidth, rectHeight);
+        if (emptyPixels) {
+            copyEmptyRect(emptyPixels, emptyPixelsBU, rectX, rectY, rectWidth, rectHeight);
+        }
     }
 
     // Save disposal method for this frame for next time
@@ -516,12 +1205,12 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
         rectWidth = tbiWidth;
         rectHeight = tbiHeight;
 
-        // limit rectangle to the bounds of maxGifWidth*maxGifHeight
-        if(rectX + rectWidth > maxGifWidth)
-            rectWidth = maxGifWidth-rectX;
-        if(rectY + rectHeight > maxGifHeight)
-            rectHeight = maxGifHeight-rectY;
-        if(rectX >= maxGifWidth || rectY >= maxGifHeight) {
+        // limit rectangle to the bounds of canvasWidth*canvasHeight
+        if(rectX + rectWidth > canvasWidth)
+            rectWidth = canvasWidth-rectX;
+        if(rectY + rectHeight > canvasHeight)
+            rectHeight = canvasHeight-rectY;
+        if(rectX >= canvasWidth || rectY >= canvasHeight) {
             rectX = rectY = rectWidth = rectHeight = 0;
         }
 
@@ -532,12 +1221,18 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
             else    {
                 prevBackgroundIndex = lsdBackgroundIndex;
             }
+            prevBackgroundEmpty = (transparentColorIndex != NO_TRANSPARENT_INDEX);
         }
         else if (disposalMethod == DISPOSAL_RESTORE) {
             copyImageDataRect(imageDataBU, imageData, rectX, rectY, rectWidth, rectHeight);
+            if (emptyPixels) {
+                copyEmptyRect(emptyPixelsBU, emptyPixels, rectX, rectY, rectWidth, rectHeight);
+            }
         }
     }
 
+    GIF_STATS_ENTER(stats, GIF_STAGE_PARSE);
+
     // Read the min LZW code size
     lzwCodeSize = readByte();
 
@@ -545,53 +1240,53 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
     Serial.print("LzwCodeSize: ");
     Serial.println(lzwCodeSize);
     Serial.println("File Position Before: ");
-    Serial.println(filePositionCallback());
-#endif
-
-    unsigned long filePositionBefore = filePositionCallback();
-
-    // Gather the lzw image data
-    // NOTE: the dataBlockSize byte is left in the data as the lzw decoder needs it
-    int offset = 0;
-    int dataBlockSize = readByte();
-    while (dataBlockSize != 0) {
-#if GIFDEBUG == 1 && DEBUG_PROCESSING_TBI_DESC_DATABLOCKSIZE == 1
-    Serial.print("dataBlockSize: ");
-    Serial.println(dataBlockSize);
+    Serial.println(streamPosition());
 #endif
-        backUpStream(1);
-        dataBlockSize++;
-        fileSeekCallback(filePositionCallback() + dataBlockSize);
-
-        offset += dataBlockSize;
-        dataBlockSize = readByte();
-    }
-
-#if GIFDEBUG == 1 && DEBUG_PROCESSING_TBI_DESC_LZWIMAGEDATA_SIZE == 1
-    Serial.print("total lzwImageData Size: ");
-    Serial.println(offset);
-    Serial.println("File Position Test: ");
-    Serial.println(filePositionCallback());
-#endif
-
-    // this is the position where GIF decoding needs to pick up after decompressing frame
-    unsigned long filePositionAfter = filePositionCallback();
-
-    fileSeekCallback(filePositionBefore);
 
     // Process the animation frame for display
+    // NOTE: the LZW decoder reads the data sub-blocks straight from the stream in a single pass
 
     // Initialize the LZW decoder for this frame
     lzw_decode_init(lzwCodeSize);
-    lzw_setTempBuffer((uint8_t*)tempBuffer);
 
     // Make sure there is at least some delay between frames
     if (frameDelay < 1) {
         frameDelay = 1;
     }
 
+    // Frames decoded in order extend the frame index
+    if (frameIndex && (currentFrame == frameCount) && (frameCount < frameIndexSize)) {
+        gif_frame_info &info = frameIndex[frameCount++];
+        info.filePosition = frameStartPosition;
+        info.frameDelay = frameDelay;
+        info.disposalMethod = disposalMethod;
+        info.reserved = 0;
+        info.x = tbiImageX;
+        info.y = tbiImageY;
+        info.width = tbiWidth;
+        info.height = tbiHeight;
+    }
+
+    // A frame that would be over before it could be shown is drawn like any other
+    // but never presented, the next frame shown includes what it changed
+    frameDropped = dropping && clock->isOver(frameDelay);
+
     // Decompress LZW data and display the frame
-    decompressAndDisplayFrame(filePositionAfter);
+    decompressAndDisplayFrame();
+
+    if (frameDropped) {
+        framePending = false;
+        clock->advance(frameDelay);
+        droppedFrames++;
+        GIF_STATS_DROPPED(stats);
+        uniteRect(droppedX, droppedY, droppedWidth, droppedHeight, dirtyX, dirtyY, dirtyWidth, dirtyHeight);
+    }
+
+    GIF_STATS_ENTER(stats, GIF_STAGE_COMPOSITE);
+    saveFrameSnapshot();
+    GIF_STATS_ENTER(stats, GIF_STAGE_PARSE);
+    // Everything from the first extension of the frame to the end of its image data
+    GIF_STATS_BYTES(stats, streamPosition() - frameStartPosition);
 
     // Graphic control extension is for a single frame
     transparentColorIndex = NO_TRANSPARENT_INDEX;
@@ -599,10 +1294,12 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseTableBasedImage() {
 }
 
 // Parse gif data
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseData() {
-    if(nextFrameTime_ms > millis()) 
-        return ERROR_WAITING;
+int GifDecoder::parseData() {
+
+    GIF_STATS_ENTER(stats, GIF_STAGE_PARSE);
+
+    // Every block up to the next image belongs to the next frame
+    frameStartPosition = streamPosition();
 
 #if GIFDEBUG == 1 && DEBUG_PARSING_DATA == 1
     Serial.println("\nParsing Data Block");
@@ -674,18 +1371,75 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::parseData() {
     return ERROR_NONE;
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::startDecoding(void) {
+int GifDecoder::startDecoding(void) {
     // Initialize variables
-    keyFrame = true;
-    prevDisposalMethod = DISPOSAL_NONE;
-    transparentColorIndex = NO_TRANSPARENT_INDEX;
-    nextFrameTime_ms = 0;
-    fileSeekCallback(0);
+    resetDecoderState();
+    arenaReady = false;
+    clock->reset();
+    framePending = false;
+    droppedFrames = 0;
+    droppedWidth = droppedHeight = 0;
+    fileCallbacks = 0;
+    fileCallbacksLastFrame = 0;
+    loopsCompleted = 0;
+
+    int result = readFileInfo(false);
+    if (result != ERROR_NONE) {
+        return result;
+    }
+    result = layoutArena();
+    if (result == ERROR_OUTOFMEMORY) {
+        Serial.print("startDecoding(), arena too small, bytes needed: ");
+        Serial.println(arenaNeeded);
+    }
+    return result;
+}
+
+int GifDecoder::probe(gif_info &info) {
+    memset(&info, 0, sizeof(info));
+    resetDecoderState();
+    arenaReady = false;
+    framePending = false;
+
+    int result = readFileInfo(true);
+    if (result != ERROR_NONE) {
+        return result;
+    }
+
+    // Size the buffers without an arena, none of them is used before startDecoding()
+    uint8_t *keptArena = arena;
+    size_t keptArenaSize = arenaSize;
+    arena = NULL;
+    arenaSize = 0;
+    layoutArena();
+    arena = keptArena;
+    arenaSize = keptArenaSize;
+
+    info.width = lsdWidth;
+    info.height = lsdHeight;
+    info.frameCount = fileFrameCount;
+    info.duration_ms = fileDuration_ms;
+    info.loopCount = loopCount;
+    info.maxLzwCodeSize = maxLzwCodeSize;
+    info.arenaNeeded = arenaNeeded;
+    return ERROR_NONE;
+}
+
+// Header, logical screen and global color table, then a walk through all other blocks
+// The palette isn't loaded while probing, the table is only skipped
+int GifDecoder::readFileInfo(bool probing) {
+    globalColorCount = 0;
+
+    // A new file may be behind the callbacks, never serve stale buffered data
+    resetReadBuffer();
+    if (!fileData) {
+        fileCallbacks++;
+        fileSeekCallback(callbackUser, 0);
+    }
 
     // Validate the header
     if (! parseGifHeader()) {
-        Serial.println("startDecoding(), Not a GIF file");
+        Serial.println("Not a GIF file");
         return ERROR_FILENOTGIF;
     }
     // If we get here we have a gif file to process
@@ -693,16 +1447,50 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::startDecoding(void) {
     // Parse the logical screen descriptor
     parseLogicalScreenDescriptor();
 
+    // The canvas is the logical screen cut down to maxWidth x maxHeight
+    canvasWidth = ((lsdWidth > 0) && (lsdWidth < maxWidth)) ? lsdWidth : maxWidth;
+    canvasHeight = ((lsdHeight > 0) && (lsdHeight < maxHeight)) ? lsdHeight : maxHeight;
+
+    // Frames are scaled from the logical screen down to the canvas, never up
+    scaleWidth = ((scaleMode != GIF_SCALE_NONE) && (lsdWidth > canvasWidth)) ? lsdWidth : canvasWidth;
+    scaleHeight = ((scaleMode != GIF_SCALE_NONE) && (lsdHeight > canvasHeight)) ? lsdHeight : canvasHeight;
+
     // Parse the global color table
-    parseGlobalColorTable();
+    if (!probing) {
+        parseGlobalColorTable();
+    }
+    else if (lsdPackedField & COLORTBLFLAG) {
+        globalColorCount = 1 << ((lsdPackedField & 7) + 1);
+        seekStream(streamPosition() + sizeof(rgb_24) * globalColorCount);
+    }
+    firstFramePosition = streamPosition();
 
-    return ERROR_NONE;
+    // What the buffers for this file have to hold
+    return scanFrames();
 }
 
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::decodeFrame(void) {
-    // Parse gif data
+int GifDecoder::decodeFrame(void) {
+    // Nothing to decode into before startDecoding() succeeded
+    if(!arenaReady)
+        return ERROR_OUTOFMEMORY;
+
+    // The last frame has to be shown before the next one can be drawn
+    if(framePending)
+        return ERROR_WAITING;
+
+    // Parse gif data, late frames are dropped until one can still be shown
+    dropping = dropLateFrames;
     int result = parseData();
+    while ((result == ERROR_NONE) && frameDropped) {
+        result = parseData();
+    }
+    dropping = false;
+    GIF_STATS_ENTER(stats, GIF_STAGE_WAIT);
+    if ((result == ERROR_NONE) && (droppedWidth > 0)) {
+        uniteRect(dirtyX, dirtyY, dirtyWidth, dirtyHeight, droppedX, droppedY, droppedWidth, droppedHeight);
+        droppedWidth = droppedHeight = 0;
+    }
+
     if (result < ERROR_NONE) {
         Serial.println("Error: ");
         Serial.println(result);
@@ -710,64 +1498,537 @@ int GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::decodeFrame(void) {
         return result;
     }
 
+    if (result == ERROR_NONE) {
+        fileCallbacksLastFrame = fileCallbacks;
+        fileCallbacks = 0;
+    }
+
     if (result == ERROR_DONE_PARSING) {
-        //startDecoding();
-        // Initialize variables like with a new file
-        keyFrame = true;
-        prevDisposalMethod = DISPOSAL_NONE;
-        transparentColorIndex = NO_TRANSPARENT_INDEX;
-        nextFrameTime_ms = 0;
-        fileSeekCallback(0);
+        // Every frame made it into the index if they were all decoded in order
+        if (frameIndex && (currentFrame + 1 == frameCount)) {
+            frameIndexComplete = true;
+        }
 
-        // parse Gif Header like with a new file
-        parseGifHeader();
+        // Start over at the first frame, header and screen descriptor are still
+        // what startDecoding() read and the trailer is usually still buffered
+        // The clock keeps running, the last frame stays up for its full delay
+        loopsCompleted++;
+        resetDecoderState();
+        seekStream(firstFramePosition);
+    }
 
-        // Parse the logical screen descriptor
-        parseLogicalScreenDescriptor();
+    return result;
+}
 
-        // Parse the global color table
-        parseGlobalColorTable();
+// Decode and display any frame in the frame index
+// Starts from the closest snapshot (or the current frame) before it, frames in
+// between are decoded without being displayed
+int GifDecoder::decodeFrameAt(int frame) {
+    if (!frameIndex || (frame < 0) || (frame >= frameCount)) {
+        return ERROR_BADFRAME;
+    }
+
+    if(!arenaReady)
+        return ERROR_OUTOFMEMORY;
+
+    if(framePending)
+        return ERROR_WAITING;
+
+    int slot = -1;
+    if (frameSnapshots && (frame > 0)) {
+        slot = min((frame - 1) / frameSnapshotInterval, frameSnapshotCount - 1);
+        while ((slot >= 0) && ((frameSnapshots[slot].frame < 0) || (frameSnapshots[slot].frame >= frame))) {
+            slot--;
+        }
     }
 
+    int from = (slot >= 0) ? frameSnapshots[slot].frame : -1;
+    if ((currentFrame < frame) && (currentFrame >= from)) {
+        // Carry on from the current frame
+    }
+    else if (slot >= 0) {
+        GIF_STATS_ENTER(stats, GIF_STAGE_COMPOSITE);
+        restoreFrameSnapshot(slot);
+    }
+    else {
+        resetDecoderState();
+        fillCanvas = streamRows;
+    }
+
+    int result = ERROR_NONE;
+    // Streamed frames have to be drawn, the screen is their canvas
+    silentFrame = !streamRows;
+    while ((currentFrame < frame - 1) && (result == ERROR_NONE)) {
+        seekStream(frameIndex[currentFrame + 1].filePosition);
+        result = parseData();
+    }
+    silentFrame = false;
+
+    if (result == ERROR_NONE) {
+        // The screen shows some other frame, draw the whole canvas
+        redrawCanvas = true;
+        droppedWidth = droppedHeight = 0;
+        seekStream(frameIndex[frame].filePosition);
+        result = parseData();
+        redrawCanvas = false;
+    }
+    GIF_STATS_ENTER(stats, GIF_STAGE_WAIT);
+
+    if (result != ERROR_NONE) {
+        // Index doesn't match the file
+        Serial.println("decodeFrameAt(), frame index out of date");
+        return ERROR_BADFRAME;
+    }
     return result;
 }
 
-// Decompress LZW data and display animation frame
-template <int maxGifWidth, int maxGifHeight, int lzwMaxBits>
-void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::decompressAndDisplayFrame(unsigned long filePositionAfter) {
+bool GifDecoder::isScaling() {
+    return (scaleWidth > canvasWidth) || (scaleHeight > canvasHeight);
+}
 
-    // Each pixel of image is 8 bits and is an index into the palette
+// Map a span of the logical screen to the canvas pixels it touches, source pixel
+// s lands on canvas pixel s * canvasSize / scaleSize
+void GifDecoder::scaleRect(int &start, int &size, int scaleSize, int canvasSize) {
+    int end = (size > 0) ? ((start + size - 1) * canvasSize / scaleSize) + 1 : 0;
+    start = start * canvasSize / scaleSize;
+    if (start >= canvasSize) {
+        start = canvasSize;
+    }
+    size = (end > start) ? min(end, canvasSize) - start : 0;
+}
 
-        // How the image is decoded depends upon whether it is interlaced or not
-    // Decode the interlaced LZW data into the image buffer
-    if (tbiInterlaced) {
-        // Decode every 8th line starting at line 0
-        for (int line = tbiImageY + 0; line < tbiHeight + tbiImageY; line += 8) {
-            lzw_decode(imageData + (line * maxGifWidth) + tbiImageX, tbiWidth, min(imageData + (line * maxGifWidth) + maxGifWidth, imageData + sizeof(imageData)));
+// First logical screen pixel that lands on canvas pixel c
+int GifDecoder::scaleStart(int c, int scaleSize, int canvasSize) {
+    return ((c * scaleSize) + canvasSize - 1) / canvasSize;
+}
+
+// Logical screen pixel in the middle of the ones landing on canvas pixel c
+int GifDecoder::scaleSample(int c, int scaleSize, int canvasSize) {
+    return (scaleStart(c, scaleSize, canvasSize) + scaleStart(c + 1, scaleSize, canvasSize) - 1) / 2;
+}
+
+// Decode a frame larger than the canvas a chunk at a time and scale it down into
+// imageData, the full size frame is never held in memory
+void GifDecoder::decodeScaledFrame() {
+    static const uint8_t passStart[] = { 0, 4, 2, 1 };
+    static const uint8_t passStep[] = { 8, 8, 4, 2 };
+
+    // Interlaced rows don't arrive in order, they are only averaged horizontally
+    bool boxRows = (scaleMode == GIF_SCALE_BOX) && !tbiInterlaced;
+    int boxY = -1;
+    clearScaledRow();
+
+    int passes = tbiInterlaced ? 4 : 1;
+    for (int pass = 0; pass < passes; pass++) {
+        int start = tbiInterlaced ? passStart[pass] : 0;
+        int step = tbiInterlaced ? passStep[pass] : 1;
+
+        for (int y = srcImageY + start; y < srcImageY + srcHeight; y += step) {
+            int canvasY = y * canvasHeight / scaleHeight;
+            if (canvasY >= canvasHeight) {
+                decodeScaledRow(-1);
+                continue;
+            }
+
+            if (boxRows) {
+                // All rows landing on canvasY are summed up, store them when the next one starts
+                if (canvasY != boxY) {
+                    if (boxY >= 0) {
+                        storeScaledRow(boxY);
+                    }
+                    boxY = canvasY;
+                }
+                decodeScaledRow(canvasY);
+                continue;
+            }
+
+            // Only the row in the middle of the ones landing on canvasY is used
+            if (y != scaleSample(canvasY, scaleHeight, canvasHeight)) {
+                decodeScaledRow(-1);
+                continue;
+            }
+            decodeScaledRow(canvasY);
+            if (scaleMode == GIF_SCALE_BOX) {
+                storeScaledRow(canvasY);
+            }
+        }
+    }
+
+    if (boxY >= 0) {
+        storeScaledRow(boxY);
+    }
+}
+
+// Decode one row of the frame, canvasY < 0 only skips it
+// Nearest neighbour stores the pixel in the middle of each canvas pixel right away,
+// box filtering sums up the colors of all pixels landing on it
+void GifDecoder::decodeScaledRow(int canvasY) {
+    int x = srcImageX;
+    int end = srcImageX + srcWidth;
+
+    int canvasX = x * canvasWidth / scaleWidth;
+    int nextStart = scaleStart(canvasX + 1, scaleWidth, canvasWidth);
+    int sampleX = scaleSample(canvasX, scaleWidth, canvasWidth);
+    uint8_t *row = imageData + ((canvasY >= 0) ? canvasY * canvasWidth : 0);
+
+    while (x < end) {
+        int n = lzw_decode(scaleChunk, min(end - x, GIF_SCALE_CHUNK_SIZE), scaleChunk + GIF_SCALE_CHUNK_SIZE);
+        if (n <= 0) {
+            // Out of data
+            return;
         }
-        // Decode every 8th line starting at line 4
-        for (int line = tbiImageY + 4; line < tbiHeight + tbiImageY; line += 8) {
-            lzw_decode(imageData + (line * maxGifWidth) + tbiImageX, tbiWidth, min(imageData + (line * maxGifWidth) + maxGifWidth, imageData + sizeof(imageData)));
+
+        if (canvasY < 0) {
+            // Skipped row
         }
-        // Decode every 4th line starting at line 2
-        for (int line = tbiImageY + 2; line < tbiHeight + tbiImageY; line += 4) {
-            lzw_decode(imageData + (line * maxGifWidth) + tbiImageX, tbiWidth, min(imageData + (line * maxGifWidth) + maxGifWidth, imageData + sizeof(imageData)));
+        else if (scaleMode != GIF_SCALE_BOX) {
+            while ((canvasX < canvasWidth) && (sampleX < x + n)) {
+                // Frames starting right of the middle leave the canvas pixel alone
+                if (sampleX >= x) {
+                    row[canvasX] = scaleChunk[sampleX - x];
+                }
+                canvasX++;
+                sampleX = scaleSample(canvasX, scaleWidth, canvasWidth);
+            }
         }
-        // Decode every 2nd line starting at line 1
-        for (int line = tbiImageY + 1; line < tbiHeight + tbiImageY; line += 2) {
-            lzw_decode(imageData + (line * maxGifWidth) + tbiImageX, tbiWidth, min(imageData + (line * maxGifWidth) + maxGifWidth, imageData + sizeof(imageData)));
+        else {
+            for (int i = 0; i < n; i++) {
+                if (x + i == nextStart) {
+                    canvasX++;
+                    nextStart = scaleStart(canvasX + 1, scaleWidth, canvasWidth);
+                }
+                if (canvasX >= canvasWidth) {
+                    break;
+                }
+
+                int pixel = scaleChunk[i];
+                if (pixel == transparentColorIndex) {
+                    scaleTransparent[canvasX]++;
+                    continue;
+                }
+                scaleSum[canvasX][0] += palette[pixel].red;
+                scaleSum[canvasX][1] += palette[pixel].green;
+                scaleSum[canvasX][2] += palette[pixel].blue;
+                scaleOpaque[canvasX]++;
+
+                // Single colored canvas pixels need no palette search
+                if (scaleIndex[canvasX] == SCALE_INDEX_NONE) {
+                    scaleIndex[canvasX] = pixel;
+                }
+                else if (scaleIndex[canvasX] != pixel) {
+                    scaleIndex[canvasX] = SCALE_INDEX_MIXED;
+                }
+            }
         }
+        x += n;
     }
-    else    {
-        // Decode the non interlaced LZW data into the image data buffer
-        for (int line = tbiImageY; line < tbiHeight + tbiImageY; line++) {
-            lzw_decode(imageData  + (line * maxGifWidth) + tbiImageX, tbiWidth, imageData + sizeof(imageData));
+}
+
+// Turn the summed up colors into palette indices, mostly transparent pixels stay transparent
+void GifDecoder::storeScaledRow(int canvasY) {
+    uint8_t *row = imageData + (canvasY * canvasWidth);
+
+    for (int x = tbiImageX; x < tbiImageX + tbiWidth; x++) {
+        int opaque = scaleOpaque[x];
+        if (opaque < scaleTransparent[x]) {
+            row[x] = transparentColorIndex;
+        }
+        else if (scaleIndex[x] >= 0) {
+            row[x] = scaleIndex[x];
+        }
+        else if (opaque > 0) {
+            row[x] = closestColorIndex((scaleSum[x][0] + (opaque / 2)) / opaque,
+                                       (scaleSum[x][1] + (opaque / 2)) / opaque,
+                                       (scaleSum[x][2] + (opaque / 2)) / opaque);
+        }
+    }
+
+    clearScaledRow();
+}
+
+void GifDecoder::clearScaledRow() {
+    memset(scaleSum, 0, canvasWidth * sizeof(scaleSum[0]));
+    memset(scaleOpaque, 0, canvasWidth * sizeof(scaleOpaque[0]));
+    memset(scaleTransparent, 0, canvasWidth * sizeof(scaleTransparent[0]));
+    for (int x = 0; x < canvasWidth; x++) {
+        scaleIndex[x] = SCALE_INDEX_NONE;
+    }
+}
+
+// Rows of an interlaced frame in the order its data has them, every 8th from 0, every
+// 8th from 4, every 4th from 2 and every 2nd from 1. Stops at the first row that isn't
+// one of the first rows, returns the number of rows in interlacedRows.
+int GifDecoder::fillInterlacedRows(int rows) {
+    static const uint8_t passStart[] = { 0, 4, 2, 1 };
+    static const uint8_t passStep[] = { 8, 8, 4, 2 };
+
+    int count = 0;
+    for (int pass = 0; pass < 4; pass++) {
+        for (int y = passStart[pass]; y < tbiHeight; y += passStep[pass]) {
+            if (y >= rows) {
+                return count;
+            }
+            interlacedRows[count++] = y;
+        }
+    }
+    return count;
+}
+
+uint8_t GifDecoder::closestColorIndex(int red, int green, int blue) {
+    int closest = 0;
+    long closestDistance = 0x7fffffff;
+    for (int i = 0; i < colorCount; i++) {
+        if (i == transparentColorIndex) {
+            continue;
+        }
+        int dr = red - palette[i].red;
+        int dg = green - palette[i].green;
+        int db = blue - palette[i].blue;
+        long distance = (long)(dr * dr) + (dg * dg) + (db * db);
+        if (distance < closestDistance) {
+            closest = i;
+            closestDistance = distance;
+            if (distance == 0) {
+                break;
+            }
+        }
+    }
+    return closest;
+}
+
+// Hand a row to drawRowCallback, or drawPixelCallback without one. A row of a frame with
+// transparency goes out as spans between runs of transparent pixels, sinks copy spans
+// without any transparent pixel in them without testing each one.
+void GifDecoder::drawRow(int16_t x, int16_t y, const uint8_t *indices, int16_t width) {
+    if (transparentColorIndex == NO_TRANSPARENT_INDEX) {
+        drawSpan(x, y, indices, width, NO_TRANSPARENT_INDEX);
+        return;
+    }
+
+    int start = skipTransparent(indices, 0, width);
+    while (start < width) {
+        bool gaps;
+        int end = findTransparentRun(indices, start, width, gaps);
+        drawSpan(x + start, y, indices + start, end - start, gaps ? transparentColorIndex : NO_TRANSPARENT_INDEX);
+        start = skipTransparent(indices, end, width);
+    }
+}
+
+// Draw a row of the canvas but its empty pixels, see emptyPixels
+void GifDecoder::drawCanvasRow(int16_t y) {
+    const uint8_t *row = imageData + (y * canvasWidth);
+    int x = 0;
+    while (x < canvasWidth) {
+        while ((x < canvasWidth) && isEmptyPixel((y * canvasWidth) + x)) {
+            x++;
+        }
+        int start = x;
+        while ((x < canvasWidth) && !isEmptyPixel((y * canvasWidth) + x)) {
+            x++;
+        }
+        if (x > start) {
+            drawSpan(start, y, row + start, x - start, NO_TRANSPARENT_INDEX);
+        }
+    }
+}
+
+// Draw a span, pixels equal to transparentIndex are left alone
+void GifDecoder::drawSpan(int16_t x, int16_t y, const uint8_t *indices, int16_t width, int transparentIndex) {
+    if(drawRowCallback) {
+        (*drawRowCallback)(callbackUser, x, y, indices, width, palette, transparentIndex);
+        return;
+    }
+
+    // Compatibility adapter, hands the span to drawPixelCallback one pixel at a time
+    if(!drawPixelCallback)
+        return;
+
+    for (int i = 0; i < width; i++) {
+        int pixel = indices[i];
+
+        // Check pixel transparency
+        if (pixel == transparentIndex) {
+            continue;
+        }
+
+        // Pixel not transparent so get color from palette and draw the pixel
+        (*drawPixelCallback)(callbackUser, x + i, y, palette[pixel].red, palette[pixel].green, palette[pixel].blue);
+    }
+}
+
+// Position of the first opaque pixel from i on, width when there's none
+int GifDecoder::skipTransparent(const uint8_t *indices, int i, int width) {
+    uint32_t pattern = 0x01010101UL * (uint8_t)transparentColorIndex;
+    for (; i + 4 <= width; i += 4) {
+        uint32_t word;
+        memcpy(&word, &indices[i], sizeof(word));
+        if (word != pattern) {
+            break;
+        }
+    }
+    while (i < width && indices[i] == transparentColorIndex) {
+        i++;
+    }
+    return i;
+}
+
+// End of the span starting at i, 4 pixels at a time until all of them are transparent.
+// Single transparent pixels stay in the span, gaps tells whether there were any: after
+// xoring a word with the transparent index in every byte they are its zero bytes.
+int GifDecoder::findTransparentRun(const uint8_t *indices, int i, int width, bool &gaps) {
+    uint32_t pattern = 0x01010101UL * (uint8_t)transparentColorIndex;
+    uint32_t zeroBytes = 0;
+    for (; i + 4 <= width; i += 4) {
+        uint32_t word;
+        memcpy(&word, &indices[i], sizeof(word));
+        if (word == pattern) {
+            gaps = (zeroBytes != 0);
+            return i;
+        }
+        word ^= pattern;
+        zeroBytes |= (word - 0x01010101UL) & ~word & 0x80808080UL;
+    }
+    for (; i < width; i++) {
+        if (indices[i] == transparentColorIndex) {
+            zeroBytes = 1;
+        }
+    }
+    gaps = (zeroBytes != 0);
+    return i;
+}
+
+// Show the frame drawn by decodeFrame() or decodeFrameAt() once the previous
+// frame's delay is over, returns ERROR_WAITING until then
+int GifDecoder::presentFrame(void) {
+    if(!framePending)
+        return ERROR_NONE;
+
+    if(!clock->isDue())
+        return ERROR_WAITING;
+
+    GIF_STATS_LATENESS(stats, clock->getLateness());
+
+    // The next frame is due frameDelay after this one was, not after it's shown
+    clock->advance(frameDelay);
+    framePending = false;
+    if(updateScreenCallback)
+        (*updateScreenCallback)(callbackUser);
+
+    return ERROR_NONE;
+}
+
+// Decode and draw a frame of a file without canvas a row at a time, rows are drawn
+// as soon as they are decoded and never stored
+void GifDecoder::streamFrame() {
+    static const uint8_t passStart[] = { 0, 4, 2, 1 };
+    static const uint8_t passStep[] = { 8, 8, 4, 2 };
+
+    GIF_STATS_ENTER(stats, GIF_STAGE_OUTPUT);
+
+    // Optional callback can be used to get drawing routines ready
+    if(startDrawingCallback)
+        (*startDrawingCallback)(callbackUser);
+
+    if (fillCanvas) {
+        // Started over to seek, the first frame goes on the background like on a new canvas
+        if(screenClearCallback)
+            (*screenClearCallback)(callbackUser);
+        memset(rowBuffer, lsdBackgroundIndex, canvasWidth);
+        for (int y = 0; y < canvasHeight; y++) {
+            drawRow(0, y, rowBuffer, canvasWidth);
+        }
+        fillCanvas = false;
+    }
+
+    // Only the part on the canvas can be drawn
+    int drawX = min(tbiImageX, canvasWidth);
+    int drawY = min(tbiImageY, canvasHeight);
+    int drawWidth = min(tbiWidth, canvasWidth - drawX);
+    int drawHeight = min(tbiHeight, canvasHeight - drawY);
+
+    int passes = tbiInterlaced ? 4 : 1;
+    for (int pass = 0; pass < passes; pass++) {
+        int start = tbiInterlaced ? passStart[pass] : 0;
+        int step = tbiInterlaced ? passStep[pass] : 1;
+
+        for (int y = tbiImageY + start; y < tbiImageY + tbiHeight; y += step) {
+            // What's left of a row the data ran out in stays as it was
+            GIF_STATS_ENTER(stats, GIF_STAGE_LZW);
+            int n = lzw_decode(rowBuffer, tbiWidth, rowBuffer + tbiWidth);
+            GIF_STATS_ENTER(stats, GIF_STAGE_OUTPUT);
+            if ((y < canvasHeight) && (n > 0)) {
+                drawRow(drawX, y, rowBuffer, min(n, drawWidth));
+            }
+        }
+    }
+
+    // LZW doesn't parse through all the data, skip what's left of it
+    GIF_STATS_ENTER(stats, GIF_STAGE_LZW);
+    lzw_skip_remaining();
+
+    // Seeking may have drawn more than this frame
+    if (redrawCanvas) {
+        drawX = drawY = 0;
+        drawWidth = canvasWidth;
+        drawHeight = canvasHeight;
+    }
+    dirtyX = drawX;
+    dirtyY = drawY;
+    dirtyWidth = drawWidth;
+    dirtyHeight = drawHeight;
+
+    // Frame is drawn, presentFrame() makes it visible when it's due
+    framePending = true;
+}
+
+// Decompress LZW data and draw animation frame, presentFrame() makes it visible
+void GifDecoder::decompressAndDisplayFrame() {
+
+    if (streamRows) {
+        streamFrame();
+        return;
+    }
+
+    // Each pixel of image is 8 bits and is an index into the palette
+    uint8_t *imageDataEnd = imageData + (canvasWidth * canvasHeight);
+
+    GIF_STATS_ENTER(stats, GIF_STAGE_LZW);
+
+        // How the image is decoded depends upon whether it is interlaced or not
+    // Decode the interlaced LZW data into the image buffer
+    if (isScaling()) {
+        decodeScaledFrame();
+    }
+    else {
+        // All rows in one pass over the LZW data, interlaced ones go where the row table
+        // puts them. Only rows on the canvas are decoded, rows below it end the frame,
+        // pixels right of it are skipped. Frames starting outside of it draw nothing.
+        if ((tbiWidth > 0) && (tbiImageX < canvasWidth) && (tbiImageY < canvasHeight)) {
+            int width = min(tbiWidth, canvasWidth - tbiImageX);
+            int rows = min(tbiHeight, canvasHeight - tbiImageY);
+            uint8_t *frameData = imageData + (tbiImageY * canvasWidth) + tbiImageX;
+            if (tbiInterlaced) {
+                rows = fillInterlacedRows(rows);
+            }
+            if (width == tbiWidth) {
+                lzw_decode_rows(frameData, tbiWidth, canvasWidth, tbiInterlaced ? interlacedRows : NULL, rows, imageDataEnd);
+            }
+            else {
+                // Wider than the canvas, rows go through rowBuffer and only their left part is kept
+                for (int i = 0; i < rows; i++) {
+                    int n = lzw_decode(rowBuffer, tbiWidth, rowBuffer + tbiWidth);
+                    memcpy(frameData + ((tbiInterlaced ? interlacedRows[i] : i) * canvasWidth), rowBuffer, min(n, width));
+                    if (n < tbiWidth) {
+                        break;
+                    }
+                }
+            }
         }
     }
 
 #if GIFDEBUG == 1 && DEBUG_DECOMPRESS_AND_DISPLAY == 1
     Serial.println("File Position After: ");
-    Serial.println(filePositionCallback());
+    Serial.println(streamPosition());
 #endif
 
 #if GIFDEBUG == 1 && DEBUG_WAIT_FOR_KEY_PRESS == 1
@@ -775,40 +2036,54 @@ void GifDecoder<maxGifWidth, maxGifHeight, lzwMaxBits>::decompressAndDisplayFram
     while(Serial.read() <= 0);
 #endif
 
-    // LZW doesn't parse through all the data, manually set position
-    fileSeekCallback(filePositionAfter);
+    // LZW doesn't parse through all the data, skip what's left of it
+    lzw_skip_remaining();
+
+    // Only the part on the canvas can be drawn
+    int drawX = min(tbiImageX, canvasWidth);
+    int drawY = min(tbiImageY, canvasHeight);
+    int drawWidth = min(tbiWidth, canvasWidth - drawX);
+    int drawHeight = min(tbiHeight, canvasHeight - drawY);
+    if (emptyPixels) {
+        markEmptyPixels(drawX, drawY, drawWidth, drawHeight);
+    }
+
+    if (silentFrame) {
+        return;
+    }
+    GIF_STATS_ENTER(stats, GIF_STAGE_OUTPUT);
 
     // Optional callback can be used to get drawing routines ready
     if(startDrawingCallback)
-        (*startDrawingCallback)();
+        (*startDrawingCallback)(callbackUser);
 
-    // Image data is decompressed, now display portion of image affected by frame
-    int yOffset, pixel;
-    for (int y = tbiImageY; y < tbiHeight + tbiImageY; y++) {
-        yOffset = y * maxGifWidth;
-        for (int x = tbiImageX; x < tbiWidth + tbiImageX; x++) {
-            // Get the next pixel
-            pixel = imageData[yOffset + x];
-
-            // Check pixel transparency
-            if (pixel == transparentColorIndex) {
-                continue;
-            }
+    bool wholeCanvas = redrawCanvas || canvasDisposed;
+    if (wholeCanvas) {
+        drawX = drawY = 0;
+        drawWidth = canvasWidth;
+        drawHeight = canvasHeight;
+        if(screenClearCallback)
+            (*screenClearCallback)(callbackUser);
+    }
 
-            // Pixel not transparent so get color from palette and draw the pixel
-            if(drawPixelCallback)
-                (*drawPixelCallback)(x, y, palette[pixel].red, palette[pixel].green, palette[pixel].blue);
+    // Image data is decompressed, now display portion of image affected by frame
+    // one row at a time, sinks without a row callback get single pixels. The whole
+    // canvas leaves out the empty pixels, this frame's transparent index can be a
+    // color of the ones before.
+    for (int y = drawY; y < drawHeight + drawY; y++) {
+        if (wholeCanvas && emptyPixels) {
+            drawCanvasRow(y);
+        }
+        else {
+            drawRow(drawX, y, imageData + (y * canvasWidth) + drawX, drawWidth);
         }
     }
-    // Make animation frame visible
-    // swapBuffers() call can take up to 1/framerate seconds to return (it waits until a buffer copy is complete)
-    // note the time before calling
-
-    // wait until time to display next frame
-    while(nextFrameTime_ms > millis());
-
-    // calculate time to display next frame
-    nextFrameTime_ms = millis() + (10 * frameDelay);
-    if(updateScreenCallback)
-        (*updateScreenCallback)();
+    // Part of the canvas the frame changed
+    dirtyX = drawX;
+    dirtyY = drawY;
+    dirtyWidth = drawWidth;
+    dirtyHeight = drawHeight;
+
+    // Frame is drawn, presentFrame() makes it visible when it's due
+    framePending = true;
 }
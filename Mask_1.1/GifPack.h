@@ -0,0 +1,164 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef ESP32
+#include "esp_partition.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Gifs packed into one image, a raw data partition on the ESP32 and a file on a host.
+// The image is mapped, GifDecoder::setFileData() reads a gif right where it is.
+//   header, count entries, then the files, each at a 4 byte aligned offset
+// test/host/gifpack writes it, see README.md for flashing it.
+
+#define GIF_PACK_MAGIC      0x4B434150  // "PACK"
+#define GIF_PACK_NAME_SIZE  32          // Name of a file including the terminating 0
+
+typedef struct gif_pack_header {
+    uint32_t magic;
+    uint32_t count;
+} gif_pack_header;
+
+typedef struct gif_pack_entry {
+    char name[GIF_PACK_NAME_SIZE];
+    uint32_t offset;            // From the start of the image
+    uint32_t size;
+} gif_pack_entry;
+
+class GifPack {
+public:
+    GifPack();
+    ~GifPack();
+
+    // Map the data partition with this label, or the file at this path on a host
+    bool begin(const char *name);
+    void end(void);
+    int getCount(void);
+    const char *getName(int index);
+    // Data of the packed file called name, NULL when there's none
+    const uint8_t *find(const char *name, size_t &size);
+
+private:
+    bool isValid(void);
+
+    const uint8_t *data;
+    size_t size;
+    const gif_pack_entry *entries;
+    int count;
+#ifdef ESP32
+    spi_flash_mmap_handle_t handle;
+#endif
+};
+
+GifPack::GifPack() {
+    data = NULL;
+    size = 0;
+    entries = NULL;
+    count = 0;
+}
+
+GifPack::~GifPack() {
+    end();
+}
+
+bool GifPack::begin(const char *name) {
+    end();
+
+#ifdef ESP32
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, name);
+    if (!partition) {
+        return false;
+    }
+    const void *mapped;
+    if (esp_partition_mmap(partition, 0, partition->size, SPI_FLASH_MMAP_DATA, &mapped, &handle) != ESP_OK) {
+        Serial.printf("Can not map partition %s\n", name);
+        return false;
+    }
+    size = partition->size;
+#else
+    int file = open(name, O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat info;
+    void *mapped = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+        mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    close(file);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    size = info.st_size;
+#endif
+    data = (const uint8_t *)mapped;
+
+    if (!isValid()) {
+        Serial.printf("Not a gif pack: %s\n", name);
+        end();
+        return false;
+    }
+    return true;
+}
+
+void GifPack::end(void) {
+    if (!data) {
+        return;
+    }
+#ifdef ESP32
+    spi_flash_munmap(handle);
+#else
+    munmap((void *)data, size);
+#endif
+    data = NULL;
+    size = 0;
+    entries = NULL;
+    count = 0;
+}
+
+// Header and every entry fit, an erased partition is all 0xff and fails the magic
+bool GifPack::isValid(void) {
+    gif_pack_header header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != GIF_PACK_MAGIC || header.count > (size - sizeof(header)) / sizeof(gif_pack_entry)) {
+        return false;
+    }
+
+    const gif_pack_entry *packed = (const gif_pack_entry *)(data + sizeof(header));
+    for (uint32_t i = 0; i < header.count; i++) {
+        if (packed[i].offset > size || packed[i].size > size - packed[i].offset
+            || memchr(packed[i].name, 0, GIF_PACK_NAME_SIZE) == NULL) {
+            return false;
+        }
+    }
+    entries = packed;
+    count = header.count;
+    return true;
+}
+
+int GifPack::getCount(void) {
+    return count;
+}
+
+const char *GifPack::getName(int index) {
+    return entries[index].name;
+}
+
+const uint8_t *GifPack::find(const char *name, size_t &size) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].name, name) == 0) {
+            size = entries[i].size;
+            return data + entries[i].offset;
+        }
+    }
+    size = 0;
+    return NULL;
+}
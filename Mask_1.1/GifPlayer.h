@@ -1,42 +1,58 @@
+#pragma once
+#include "PndEncoder.h"
+#include "FramePipeline.h"
 #include "GifDecoder.h"
+#include "GifPack.h"
 #include "SPIFFS.h"
 #include <FastLED.h>
 #include <vector>
 #include <map>
+#include <set>
 #include <string>
 #include "Helper.h"
 
 //#define DEBUG
 #ifdef DEBUG
 // #define DEBUG_SCREEN_CLEAR_CALLBACK
-// #define DEBUG_UPDATE_SCREEN_CALLBACK
  //#define DEBUG_DRAW_PIXEL_CALLBACK
  //#define DEBUG_FILE_SEEK_CALLBACK
  //#define DEBUG_FILE_POSITION_CALLBACK
  //#define DEBUG_FILE_READ_CALLBACK
  //#define DEBUG_FILE_READ_BLOCK_CALLBACK
+ //#define DEBUG_FILE_CALLBACKS_PER_FRAME
+ //#define DEBUG_FRAME_CACHE
+ //#define DEBUG_DRAW_CYCLES           // cycles spent drawing each frame, .pnd frames included
+ //#define DEBUG_DRAW_PIXEL_CALLBACK_ONLY  // draw through drawPixelCallback to compare
+ //#define DEBUG_DECODER_ARENA         // arena size and free heap for each gif
 #endif
 
 #define LED_PIN           15           // Output pin for LEDs [5]
 #define COLOR_ORDER       GRB         // Color order of LED string [GRB]
 #define CHIPSET           WS2812B     // LED string type [WS2182B]
 #define BRIGHTNESS        50          // Overall brightness [50]
+#define LED_CORRECTION    TypicalSMD5050  // Color correction of the leds [TypicalSMD5050]
+#define LED_GAMMA         1.0         // Gamma applied to gif colors [1.0]
+#define GIF_SCALE_MODE    GIF_SCALE_BOX  // How gifs larger than the matrix are scaled down [GIF_SCALE_BOX]
 #define kMatrixWidth      17
 #define kMatrixHeight     17
 #define NUM_LEDS (kMatrixWidth * kMatrixHeight)                                       // Total number of Leds
 #define LAST_VISIBLE_LED  220         // Last LED that's visible [102]
 
-CRGB leds[ NUM_LEDS ];
-uint8_t brightness = BRIGHTNESS;
+#define MAX_INDEXED_FRAMES      256   // Frames the frame index can hold
+#define FRAME_SNAPSHOTS         8     // Decoded frames kept around for seeking
+#define FRAME_SNAPSHOT_INTERVAL 4     // Frames between snapshots, doubles for long gifs
+#define FRAME_INDEX_MAGIC       0x58444950  // "PIDX"
+#define FRAME_CACHE_SIZE        16384 // Bytes of decoded frames kept for replaying a gif
+#define MIN_FRAME_TIME          20    // Shortest time a frame is up for in ms, FastLED.show() alone takes ~9 ms [20]
+#define HONOUR_LOOP_COUNT       true  // Play the next gif once a gif looped as often as it asks to [true]
+#define GIF_PACK_PARTITION      "gifpack"  // Data partition with more gifs, read straight from flash, see GifPack.h
+#define MAX_DECODER_ARENA       65536 // Gifs whose decoder buffers need more bytes are turned down
 
-// Helper to map XY coordinates to irregular matrix
-uint16_t XY (uint16_t x, uint16_t y) {
-  // any out of bounds address maps to the first hidden pixel
-  if ( (x >= kMatrixWidth) || (y >= kMatrixHeight) ) {
-    return (LAST_VISIBLE_LED + 1);
-  }
+// Leds shown by FastLED, the default target of every GifPlayer
+CRGB leds[ NUM_LEDS ];
 
-  const uint16_t XYTable[] = {
+// Led of each matrix position, row by row
+static const uint16_t XYTable[] = {
    277, 269, 263, 259, 257, 255, 136, 119, 102,  85,  68, 253, 251, 247, 241, 233, 221,
    278, 270, 264, 260, 168, 153, 137, 120, 103,  86,  69,  53,  38, 248, 242, 234, 222,
    279, 271, 265, 183, 169, 154, 138, 121, 104,  87,  70,  54,  39,  25, 243, 235, 223,
@@ -54,43 +70,221 @@ uint16_t XY (uint16_t x, uint16_t y) {
    286, 274, 266, 195, 181, 166, 150, 133, 116,  99,  82,  66,  51,  37, 244, 238, 230,
    287, 275, 267, 261, 182, 167, 151, 134, 117, 100,  83,  67,  52, 249, 245, 239, 231,
    288, 276, 268, 262, 258, 256, 152, 135, 118, 101,  84, 254, 252, 250, 246, 240, 232
-  };
+};
+
+// Helper to map XY coordinates to irregular matrix
+uint16_t XY (uint16_t x, uint16_t y) {
+  // any out of bounds address maps to the first hidden pixel
+  if ( (x >= kMatrixWidth) || (y >= kMatrixHeight) ) {
+    return (LAST_VISIBLE_LED + 1);
+  }
 
   uint16_t i = (y * kMatrixWidth) + x;
   uint16_t j = XYTable[i];
   return j;
 }
 
+// Per channel gamma, color correction and brightness, same scaling FastLED would do on show
+void fillOutputTables(uint8_t tables[3][256], uint8_t brightness){
+  CRGB correction(LED_CORRECTION);
+  for(int c = 0; c < 3; c++){
+    uint8_t scale = ((correction.raw[c] + 1) * brightness) >> 8;
+    for(int i = 0; i < 256; i++){
+      uint8_t value = 255.0f * powf(i / 255.0f, LED_GAMMA) + 0.5f;
+      tables[c][i] = scale8(value, scale);
+    }
+  }
+}
+
+// FastLED's byte order encoding, e.g. GRB is 0102
+CRGB toColorOrder(const CRGB & color){
+  return CRGB(color.raw[(COLOR_ORDER >> 6) & 3], color.raw[(COLOR_ORDER >> 3) & 3], color.raw[COLOR_ORDER & 3]);
+}
+
 class GifPlayer{
 
 public:
 
-    GifPlayer(){}
+    enum PlayMode { PLAY_FORWARD, PLAY_REVERSE, PLAY_PINGPONG };
+    enum FrameCacheState { CACHE_FILLING, CACHE_READY, CACHE_OFF };
+
+    // A cached frame, data is at frameCacheData[slot * NUM_LEDS]
+    typedef struct {
+      uint16_t slot;
+      uint16_t frameDelay;
+    } CachedFrame;
+
+    // A decoder color table converted to output colors, palette is where the decoder keeps it
+    typedef struct {
+      const rgb_24 * palette;
+      rgb_24 raw[256];
+      CRGB colors[256];
+      int count;
+    } ConvertedPalette;
+
+    // Decodes into target, several players can run at once with a target each
+    GifPlayer(CRGB * target = ::leds) : decoder(kMatrixWidth, kMatrixHeight), leds(target){}
+    static void setupLeds();
     void setup();
     void update();
-    static void screenClearCallback();
-    static void updateScreenCallback();
-    static void drawPixelCallback(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue);
-    static bool fileSeekCallback(unsigned long position);
-    static unsigned long filePositionCallback();
-    static int fileReadCallback();
-    static int fileReadBlockCallback(void * buffer, int numberOfBytes);
+    void setPlayMode(PlayMode mode);
+    void jumpToFrame(int frame);
+    int getCurrentFrame();
+    int getLoopCount();
+    float getFrameCacheHitRate();
+    size_t getFrameCacheBytes();
+    unsigned long getSkippedShows();
+    // Decoder callbacks, user is the GifPlayer
+    static void screenClearCallback(void * user);
+    static void drawPixelCallback(void * user, int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue);
+    static void drawRowCallback(void * user, int16_t x, int16_t y, const uint8_t * indices, int16_t width, const rgb_24 * palette, int16_t transparentIndex);
+    static void paletteCallback(void * user, const rgb_24 * palette, int colorCount);
+    static void startDrawingCallback(void * user);
+    static bool fileSeekCallback(void * user, unsigned long position);
+    static unsigned long filePositionCallback(void * user);
+    static int fileReadCallback(void * user);
+    static int fileReadBlockCallback(void * user, void * buffer, int numberOfBytes);
+    void drawRow(int16_t x, int16_t y, const uint8_t * indices, int16_t width, int16_t transparentIndex);
+    void convertPalette(const rgb_24 * palette, int colorCount);
+    void updateOutputTables();
+    CRGB toOutputColor(uint8_t red, uint8_t green, uint8_t blue);
+    void setBrightness(uint8_t value);
+    void setSpeed(float speed);
+    void setLayerOutput(CRGB * target, uint8_t * alpha, callback frameCallback, void * user);
+    void setPipeline(FramePipeline * pipeline);
+    #if GIF_STATS
+    void setStats(GifStats * stats);
+    #endif
     void loadGifFiles();
-    static File & getCurrentFile();
+    bool probeGif(String filename, gif_info & info);
+    bool getGifInfo(String filename, gif_info & info);
+    bool addGif(String filename);
+    File & getCurrentFile();
+    size_t getCurrentFileSize();
+    bool openCurrentFile();
     void setCurrentFilename(String filename);
+    void playNextGif();
+    bool startNextLoop();
+    void startPlaying();
+    int startDecoding();
+    static bool encodeNative(String filename);
+    static bool readNativeHeader(File & file, pnd_header & header, size_t gifSize);
+    bool openNative();
+    void rewindNative();
+    bool readNativeFrame();
+    void updateNative();
+    void convertNativePalette();
+    void drawNativeCanvas();
+    static bool nativeFileSeekCallback(void * user, unsigned long position);
+    static unsigned long nativeFilePositionCallback(void * user);
+    static int nativeFileReadCallback(void * user);
+    static int nativeFileReadBlockCallback(void * user, void * buffer, int numberOfBytes);
+    void loadFrameIndex();
+    void saveFrameIndex();
+    int getNextFrame(int frame, int frameCount);
+    void resetFrameCache();
+    void cacheFrame();
+    void updateFromCache();
+    void showLeds(int x, int y, int width, int height);
+    bool updateShownLeds(int x, int y, int width, int height);
+
+    GifDecoder decoder;
+    // Playback timeline of the decoder and the frame cache alike
+    GifClock clock;
+    CRGB * leds;
+    uint8_t brightness = BRIGHTNESS;
+
+    // Compositor layer output, see setLayerOutput()
+    bool layer = false;
+    uint8_t * alpha = NULL;
+    callback frameCallback = NULL;
+    void * frameCallbackUser = NULL;
+
+    // Shows frames on another task instead of FastLED.show(), see setPipeline()
+    FramePipeline * pipeline = NULL;
+
+    #if GIF_STATS
+    // Stage times of the frames shown, see setStats()
+    GifStats * stats = NULL;
+    #endif
+
+    // Decoder buffers, grown to fit the largest gif played so far
+    uint8_t * decoderArena = NULL;
+    size_t decoderArenaSize = 0;
 
-    GifDecoder<kMatrixWidth, kMatrixHeight, 12> decoder;    
+    PlayMode playMode = PLAY_FORWARD;
+    int pingPongDirection = 1;
+    int requestedFrame = -1;
+
+    // Loops of the current gif shown so far, gifs with a NETSCAPE loop count
+    // make way for the next one in filemap once they played that many
+    int loopsPlayed = 0;
+    unsigned long framesShown = 0;
+    // Decoded frame shown last, a loop is over when the next one isn't after it. -1 after a jump
+    int shownFrame = -1;
+
+    // Frame index, built on the first pass and kept in a sidecar file next to the gif
+    gif_frame_info frameIndex[MAX_INDEXED_FRAMES];
+    GifDecoder::FrameSnapshot frameSnapshots[FRAME_SNAPSHOTS];
+    bool frameIndexSaved = false;
+
+    // Frames of the first loop as shown on the leds, stored as indices into a small
+    // palette of their own. Later loops replay them without touching SPIFFS or LZW.
+    // Palette entries are 0xRRGGBBAA, alpha is 255 unless the player is a layer.
+    FrameCacheState frameCacheState = CACHE_FILLING;
+    std::vector<uint32_t> frameCachePalette;
+    std::vector<uint8_t> frameCacheData;
+    std::vector<CachedFrame> frameCacheFrames;
+    int frameCacheFrame = -1;
+    unsigned long frameCacheHits = 0;
+    unsigned long frameCacheMisses = 0;
+
+    // .pnd of the current gif, played instead of decoding it while playing forward.
+    // Frames only hold the pixels they change, nativeCanvas has the palette index of every led.
+    bool native = false;
+    File nativeFile;
+    pnd_header nativeHeader;
+    size_t nativeFramesPosition = 0;
+    int nativeFrame = -1;
+    int nativeFrameDelay = 0;
+    int nativeFirstRow = 0;             // rows drawn since the last show
+    int nativeLastRow = -1;
+    uint8_t nativeCanvas[NUM_LEDS];
+    uint32_t nativePalette[256];
+    CRGB nativeColors[256];
+    uint8_t nativeData[PND_MAX_FRAME_SIZE(NUM_LEDS)];
+
+    // Leds as they were last shown, FastLED.show() is skipped for frames that change none of them
+    CRGB shownLeds[NUM_LEDS];
+    unsigned long skippedShows = 0;
 
     // This Vector might be too large for ESP storage, 
     // change to store fileName if it doesn't work
-    //static std::vector<File> files;      
-    static std::map<String, File> filemap;
-    static String currentFilename;
-};
+    //std::vector<File> files;
+    std::map<String, File> filemap;
+    String currentFilename = "";
+    // filemap entry of currentFilename, file callbacks use it without a lookup
+    File currentFile;
+    // What probing found out about each gif, see probeGif()
+    std::map<String, gif_info> gifInfo;
+    // Uploaded gifs waiting for their .pnd, update() makes them one at a time
+    std::set<String> pendingNative;
+
+    // Gifs in the gif pack partition are in filemap without a File, the decoder reads
+    // them from the mapped partition. A gif on SPIFFS with the same name comes first.
+    GifPack pack;
+    const uint8_t * packedGif = NULL;
+    size_t packedGifSize = 0;
+    uint32_t drawStartCycles = 0;
 
-//std::vector<File> GifPlayer::files;
-std::map<String, File> GifPlayer::filemap;
-String GifPlayer::currentFilename = "";
+    // Gif palette converted to what goes out to the leds, brightness, gamma,
+    // correction and color order included. FastLED passes leds through as they are.
+    // The decoder's global and local color table get a slot each, outputPalette is
+    // the colors of the one frames are drawn with.
+    uint8_t outputTables[3][256];
+    ConvertedPalette convertedPalettes[2] = {};
+    const CRGB * outputPalette = convertedPalettes[0].colors;
+};
 
 void GifPlayer::loadGifFiles(){
 
@@ -122,24 +316,689 @@ void GifPlayer::loadGifFiles(){
         file = dir.openNextFile();
       }
     }
-    
-    
+
+    if(pack.begin(GIF_PACK_PARTITION)){
+      for(int i = 0; i < pack.getCount(); i++){
+        filemap.insert({String(pack.getName(i)), File()});
+      }
+    }
+
+    // gifs that can't be played are left out, the arena fits the largest one right away
+    gifInfo.clear();
+    size_t arenaNeeded = 0;
+    for(std::map<String, File>::iterator itr = filemap.begin(); itr != filemap.end();){
+      gif_info info;
+      if(!probeGif(itr->first, info)){
+        itr = filemap.erase(itr);
+        continue;
+      }
+      gifInfo[itr->first] = info;
+      arenaNeeded = max(arenaNeeded, info.arenaNeeded);
+      ++itr;
+    }
+    if(arenaNeeded > decoderArenaSize){
+      free(decoderArena);
+      decoderArena = (uint8_t *)malloc(arenaNeeded);
+      decoderArenaSize = decoderArena ? arenaNeeded : 0;
+      decoder.setArena(decoderArena, decoderArenaSize);
+    }
+
+    // gifs copied with the SPIFFS uploader get their .pnd on the first start
+    for(std::map<String, File>::iterator itr = filemap.begin(); itr != filemap.end(); ++itr){
+      if(!itr->second){
+        continue;
+      }
+      File file = SPIFFS.open(getPndPath("/gifs/" + itr->first), "r");
+      pnd_header header;
+      bool current = file && readNativeHeader(file, header, itr->second.size());
+      file.close();
+      if(!current){
+        encodeNative(itr->first);
+      }
+    }
+
     Serial.println("Registerd gif files in filemap");
     std::map<String, File>::iterator itr = filemap.begin();
     // for(auto itr=filemap.begin(); itr!=filemap.end(); ++itr){
     for(; itr!=filemap.end(); ++itr){
       String filename = itr->first;
       currentFilename = filename;
+      currentFile = itr->second;
       Serial.println(filename);
     }   
 }
 
+// Probe a gif in /gifs, or else in the gif pack, on a decoder of its own without decoding
+// it. False when the player can't play it.
+bool GifPlayer::probeGif(String filename, gif_info & info){
+  String path = "/gifs/" + filename;
+  File file;
+  size_t packedSize = 0;
+  const uint8_t * packed = NULL;
+  if(SPIFFS.exists(path)){
+    file = SPIFFS.open(path, "r");
+  }else{
+    packed = pack.find(filename.c_str(), packedSize);
+  }
+  if(!file && !packed){
+    return false;
+  }
+
+  // same canvas, scaling and snapshots as the player's decoder, so the same arena
+  GifDecoder * prober = new GifDecoder(kMatrixWidth, kMatrixHeight);
+  GifDecoder::FrameSnapshot snapshots[FRAME_SNAPSHOTS];
+  prober->setCallbackUser(&file);
+  prober->setFileSeekCallback(nativeFileSeekCallback);
+  prober->setFilePositionCallback(nativeFilePositionCallback);
+  prober->setFileReadCallback(nativeFileReadCallback);
+  prober->setFileReadBlockCallback(nativeFileReadBlockCallback);
+  prober->setFileData(packed, packedSize);
+  prober->setScaleMode(GIF_SCALE_MODE);
+  prober->setFrameSnapshots(snapshots, FRAME_SNAPSHOTS, FRAME_SNAPSHOT_INTERVAL);
+  int result = prober->probe(info);
+  delete prober;
+  file.close();
+
+  if(result < 0){
+    Serial.printf("Can not play %s, error %i\n", filename.c_str(), result);
+    return false;
+  }
+  if(info.frameCount == 0){
+    Serial.printf("Can not play %s, no frames\n", filename.c_str());
+    return false;
+  }
+  if(info.arenaNeeded > MAX_DECODER_ARENA){
+    Serial.printf("Can not play %s, %u bytes of decoder memory needed\n", filename.c_str(), (unsigned)info.arenaNeeded);
+    return false;
+  }
+  return true;
+}
+
+// What probing found out about a gif, gifs added since loadGifFiles() are probed now
+bool GifPlayer::getGifInfo(String filename, gif_info & info){
+  std::map<String, gif_info>::iterator itr = gifInfo.find(filename);
+  if(itr != gifInfo.end()){
+    info = itr->second;
+    return true;
+  }
+  if(!probeGif(filename, info)){
+    return false;
+  }
+  gifInfo[filename] = info;
+  return true;
+}
+
+// A gif was uploaded to /gifs, false when it can't be played. Gifs that can go in filemap
+// and get their .pnd from update(), the upload request doesn't wait for it.
+bool GifPlayer::addGif(String filename){
+  gif_info info;
+  gifInfo.erase(filename);
+  pendingNative.erase(filename);
+
+  // the File of an earlier upload with the same name is stale
+  std::map<String, File>::iterator itr = filemap.find(filename);
+  if(itr != filemap.end()){
+    itr->second.close();
+    filemap.erase(itr);
+  }
+
+  bool playable = probeGif(filename, info);
+  if(playable){
+    gifInfo[filename] = info;
+    filemap[filename] = SPIFFS.open("/gifs/" + filename, "r");
+    pendingNative.insert(filename);
+  }
+
+  // the gif playing was replaced, start over with the new one or move on
+  if(filename == currentFilename){
+    if(playable){
+      setCurrentFilename(filename);
+    }else if(!filemap.empty()){
+      playNextGif();
+    }
+  }
+  return playable;
+}
+
 void GifPlayer::setCurrentFilename(String filename){
   currentFilename = filename;
+
+  // decoder still holds buffered data of the previous file, start over
+  if(openCurrentFile()){
+    requestedFrame = -1;
+    shownFrame = -1;
+    loopsPlayed = 0;
+    framesShown = 0;
+    resetFrameCache();
+    startPlaying();
+  }
+}
+
+// Next gif in filemap, back to the first one after the last
+void GifPlayer::playNextGif(){
+  std::map<String, File>::iterator itr = filemap.upper_bound(currentFilename);
+  if(itr == filemap.end()){
+    itr = filemap.begin();
+  }
+  setCurrentFilename(itr->first);
+}
+
+// Called when the frame due isn't after the one shown last, frame 0 may have been dropped.
+// True when the gif has looped as often as it asks to and the next one was started instead
+bool GifPlayer::startNextLoop(){
+  if(playMode != PLAY_FORWARD || framesShown == 0){
+    return false;
+  }
+  loopsPlayed++;
+  int loopCount = getLoopCount();
+  if(!HONOUR_LOOP_COUNT || loopCount == 0 || loopsPlayed < loopCount || filemap.size() < 2){
+    return false;
+  }
+  playNextGif();
+  return true;
+}
+
+// Play the .pnd of the current gif when there is one, decode the gif otherwise
+void GifPlayer::startPlaying(){
+  if(!openNative()){
+    loadFrameIndex();
+    startDecoding();
+  }
+}
+
+// Start decoding the current file, the arena is only replaced when it's too small
+int GifPlayer::startDecoding(){
+  int result = decoder.startDecoding();
+  if(result == ERROR_OUTOFMEMORY){
+    size_t size = decoder.getArenaNeeded();
+    free(decoderArena);
+    decoderArena = (uint8_t *)malloc(size);
+    decoderArenaSize = decoderArena ? size : 0;
+    decoder.setArena(decoderArena, decoderArenaSize);
+    if(!decoderArena){
+      Serial.printf("Not enough memory for %s, %u bytes needed\n", currentFilename.c_str(), (unsigned)size);
+      return result;
+    }
+    result = decoder.startDecoding();
+  }
+
+  #ifdef DEBUG_DECODER_ARENA
+  Serial.printf(">>> decoder arena: %u of %u bytes, free heap: %u, min free heap: %u\n",
+    (unsigned)decoder.getArenaNeeded(), (unsigned)decoderArenaSize, ESP.getFreeHeap(), ESP.getMinFreeHeap());
+  #endif
+  return result;
+}
+
+void GifPlayer::setPlayMode(PlayMode mode){
+  playMode = mode;
+  pingPongDirection = 1;
+
+  // .pnd frames only play forward, the gif is decoded from the frame shown on
+  if(native && mode != PLAY_FORWARD){
+    int frame = nativeFrame;
+    setCurrentFilename(currentFilename);
+    requestedFrame = max(frame, 0);
+  }
+}
+
+// Show a frame as soon as it's due, normal playback carries on from there
+void GifPlayer::jumpToFrame(int frame){
+  requestedFrame = frame;
+}
+
+int GifPlayer::getCurrentFrame(){
+  if(native){
+    return nativeFrame;
+  }
+  if(frameCacheState == CACHE_READY){
+    return frameCacheFrame;
+  }
+  return decoder.getCurrentFrame();
+}
+
+// Times the current gif asks to be played, 0 for forever
+int GifPlayer::getLoopCount(){
+  return native ? nativeHeader.loopCount : decoder.getLoopCount();
+}
+
+// Frame to show next for reverse and ping-pong playback
+int GifPlayer::getNextFrame(int frame, int frameCount){
+
+  if(playMode == PLAY_FORWARD){
+    return (frame + 1 >= frameCount) ? 0 : frame + 1;
+  }
+
+  if(playMode == PLAY_REVERSE){
+    return (frame <= 0) ? frameCount - 1 : frame - 1;
+  }
+
+  if(frameCount < 2){
+    return 0;
+  }
+  if(frame + pingPongDirection >= frameCount){
+    pingPongDirection = -1;
+  }else if(frame + pingPongDirection < 0){
+    pingPongDirection = 1;
+  }
+  return frame + pingPongDirection;
+}
+
+// Share of the shown frames that came from the frame cache
+float GifPlayer::getFrameCacheHitRate(){
+  unsigned long frames = frameCacheHits + frameCacheMisses;
+  return frames ? (float)frameCacheHits / frames : 0.0f;
+}
+
+// Frames that needed no FastLED.show() because nothing visible changed
+unsigned long GifPlayer::getSkippedShows(){
+  return skippedShows;
+}
+
+// Heap the frame cache holds, what's allocated and not only what's filled
+size_t GifPlayer::getFrameCacheBytes(){
+  return frameCacheData.capacity()
+       + frameCachePalette.capacity() * sizeof(uint32_t)
+       + frameCacheFrames.capacity() * sizeof(CachedFrame);
+}
+
+void GifPlayer::resetFrameCache(){
+  frameCacheState = CACHE_FILLING;
+  frameCachePalette.clear();
+  frameCacheData.clear();
+  frameCacheFrames.clear();
+  frameCacheFrame = -1;
+  frameCacheHits = 0;
+  frameCacheMisses = 0;
+}
+
+// Add the frame just shown to the cache, only a run of frames from frame 0 in order is kept
+void GifPlayer::cacheFrame(){
+  if(frameCacheState != CACHE_FILLING){
+    return;
+  }
+
+  int frame = decoder.getCurrentFrame();
+  if(frame == 0){
+    // the cache grows with the frames, nothing is kept from a larger gif before
+    std::vector<uint32_t>().swap(frameCachePalette);
+    std::vector<uint8_t>().swap(frameCacheData);
+    std::vector<CachedFrame>().swap(frameCacheFrames);
+  }else if(frame != (int)frameCacheFrames.size()){
+    // out of order, start over at the next frame 0
+    frameCacheFrames.clear();
+    return;
+  }
+
+  // map the leds to cache palette indices
+  uint8_t indices[NUM_LEDS];
+  int last = 0;
+  for(int i = 0; i < NUM_LEDS; i++){
+    uint32_t color = ((uint32_t)leds[i].r << 24) | (leds[i].g << 16) | (leds[i].b << 8) | (alpha ? alpha[i] : 255);
+    if(last < (int)frameCachePalette.size() && frameCachePalette[last] == color){
+      indices[i] = last;
+      continue;
+    }
+    last = std::find(frameCachePalette.begin(), frameCachePalette.end(), color) - frameCachePalette.begin();
+    if(last == (int)frameCachePalette.size()){
+      if(last == 256){
+        Serial.println("Frame cache off, too many colors: " + currentFilename);
+        frameCacheState = CACHE_OFF;
+        break;
+      }
+      frameCachePalette.push_back(color);
+    }
+    indices[i] = last;
+  }
+
+  CachedFrame cached;
+  cached.frameDelay = decoder.getFrameDelay();
+
+  // identical consecutive frames share their data
+  int slots = frameCacheData.size() / NUM_LEDS;
+  if(slots > 0 && memcmp(&frameCacheData[(slots - 1) * NUM_LEDS], indices, NUM_LEDS) == 0){
+    cached.slot = slots - 1;
+  }else if(frameCacheData.size() + NUM_LEDS > FRAME_CACHE_SIZE){
+    Serial.println("Frame cache off, gif too large: " + currentFilename);
+    frameCacheState = CACHE_OFF;
+  }else{
+    cached.slot = slots;
+    if(frameCacheData.capacity() < frameCacheData.size() + NUM_LEDS){
+      // double like the vector would, but never past FRAME_CACHE_SIZE
+      frameCacheData.reserve(min(max(frameCacheData.capacity() * 2, frameCacheData.size() + NUM_LEDS), (size_t)FRAME_CACHE_SIZE));
+    }
+    frameCacheData.insert(frameCacheData.end(), indices, indices + NUM_LEDS);
+  }
+
+  if(frameCacheState == CACHE_OFF){
+    // fall back to decoding every frame, give the memory back
+    std::vector<uint32_t>().swap(frameCachePalette);
+    std::vector<uint8_t>().swap(frameCacheData);
+    std::vector<CachedFrame>().swap(frameCacheFrames);
+    return;
+  }
+  frameCacheFrames.push_back(cached);
+}
+
+// Replay the cached frames, same as decoding them but without SPIFFS or LZW
+void GifPlayer::updateFromCache(){
+  if(!clock.isDue()){
+    return;
+  }
+
+  int frameCount = frameCacheFrames.size();
+  int frame;
+  bool requested = requestedFrame >= 0;
+  if(requested){
+    frame = min(requestedFrame, frameCount - 1);
+    requestedFrame = -1;
+  }else{
+    frame = getNextFrame(frameCacheFrame, frameCount);
+  }
+
+  if(!requested && frame <= frameCacheFrame && startNextLoop()){
+    return;
+  }
+
+  // frames that would be over before they could be shown are skipped, within the loop
+  while(playMode == PLAY_FORWARD && frame + 1 < frameCount && clock.isOver(frameCacheFrames[frame].frameDelay)){
+    clock.advance(frameCacheFrames[frame].frameDelay);
+    frame++;
+    GIF_STATS_DROPPED(stats);
+  }
+
+  const CachedFrame & cached = frameCacheFrames[frame];
+  bool sameSlot = frameCacheFrame >= 0 && frameCacheFrames[frameCacheFrame].slot == cached.slot;
+  frameCacheFrame = frame;
+  frameCacheHits++;
+  framesShown++;
+  clock.advance(cached.frameDelay);
+
+  // identical frames share a slot, nothing to show
+  if(sameSlot){
+    skippedShows++;
+    GIF_STATS_END_FRAME(stats);
+    return;
+  }
+
+  GIF_STATS_ENTER(stats, GIF_STAGE_OUTPUT);
+  const uint8_t * data = &frameCacheData[cached.slot * NUM_LEDS];
+  for(int i = 0; i < NUM_LEDS; i++){
+    uint32_t color = frameCachePalette[data[i]];
+    leds[i] = CRGB(color >> 24, color >> 16, color >> 8);
+  }
+  if(alpha){
+    for(int i = 0; i < NUM_LEDS; i++){
+      alpha[i] = frameCachePalette[data[i]];
+    }
+  }
+  showLeds(0, 0, kMatrixWidth, kMatrixHeight);
+}
+
+// Convert a gif in /gifs to the .pnd played instead of it, false when it can't be
+bool GifPlayer::encodeNative(String filename){
+  String path = "/gifs/" + filename;
+  String pndPath = getPndPath(path);
+  File gif = SPIFFS.open(path, "r");
+  if(!gif){
+    return false;
+  }
+
+  PndEncoder * encoder = new PndEncoder(kMatrixWidth, kMatrixHeight);
+  encoder->setFileCallbacks(nativeFileSeekCallback, nativeFilePositionCallback, nativeFileReadCallback, nativeFileReadBlockCallback, &gif);
+  encoder->setScaleMode(GIF_SCALE_MODE);
+  std::vector<uint8_t> pnd;
+  int result = encoder->encode(pnd, gif.size());
+  delete encoder;
+  gif.close();
+
+  if(result < 0){
+    Serial.printf("Can not convert %s to pnd, error %i\n", filename.c_str(), result);
+    SPIFFS.remove(pndPath);
+    return false;
+  }
+  File file = SPIFFS.open(pndPath, "w");
+  bool written = file && file.write(pnd.data(), pnd.size()) == pnd.size();
+  file.close();
+  if(!written){
+    Serial.println("Can not write pnd: " + pndPath);
+    SPIFFS.remove(pndPath);
+    return false;
+  }
+  Serial.printf("Converted %s to pnd, %u bytes\n", filename.c_str(), (unsigned)pnd.size());
+  return true;
+}
+
+// Header of a .pnd made for the matrix from a gif of gifSize bytes
+bool GifPlayer::readNativeHeader(File & file, pnd_header & header, size_t gifSize){
+  return file.read((uint8_t *)&header, sizeof(header)) == sizeof(header)
+      && header.magic == PND_MAGIC
+      && header.gifSize == gifSize
+      && header.width == kMatrixWidth && header.height == kMatrixHeight
+      && header.frameCount > 0
+      && header.colorCount > 0 && header.colorCount <= 256;
+}
+
+// Open the .pnd of the current gif, false when there's none to play
+bool GifPlayer::openNative(){
+  native = false;
+  nativeFile.close();
+  if(playMode != PLAY_FORWARD){
+    return false;
+  }
+
+  String path = getPndPath("/gifs/" + currentFilename);
+  if(!SPIFFS.exists(path)){
+    return false;
+  }
+  nativeFile = SPIFFS.open(path, "r");
+  bool valid = readNativeHeader(nativeFile, nativeHeader, getCurrentFileSize());
+  if(valid){
+    size_t size = nativeHeader.colorCount * sizeof(uint32_t);
+    valid = nativeFile.read((uint8_t *)nativePalette, size) == size;
+  }
+  if(!valid){
+    Serial.println("Ignored stale pnd: " + path);
+    nativeFile.close();
+    return false;
+  }
+
+  nativeFramesPosition = nativeFile.position();
+  convertNativePalette();
+  native = true;
+  clock.reset();
+  rewindNative();
+  return true;
+}
+
+// Back to the blank canvas the first frame is drawn on
+void GifPlayer::rewindNative(){
+  nativeFile.seek(nativeFramesPosition);
+  nativeFrame = -1;
+  memset(nativeCanvas, 0, NUM_LEDS);
+  drawNativeCanvas();
+}
+
+// Draw the spans of the next frame, false when the .pnd is broken
+bool GifPlayer::readNativeFrame(){
+  pnd_frame frame;
+  if(nativeFile.read((uint8_t *)&frame, sizeof(frame)) != sizeof(frame)
+    || frame.size > sizeof(nativeData)
+    || nativeFile.read(nativeData, frame.size) != frame.size){
+    return false;
+  }
+
+  PndSpanReader spans(nativeData, frame.size, NUM_LEDS);
+  while(spans.next()){
+    const uint8_t * index = spans.indices;
+    int end = spans.offset + spans.count;
+    for(int i = spans.offset; i < end; i++, index += spans.step){
+      nativeCanvas[i] = *index;
+      leds[XYTable[i]] = nativeColors[*index];
+    }
+    if(alpha){
+      index = spans.indices;
+      for(int i = spans.offset; i < end; i++, index += spans.step){
+        alpha[XYTable[i]] = nativePalette[*index];
+      }
+    }
+    nativeFirstRow = min(nativeFirstRow, spans.offset / kMatrixWidth);
+    nativeLastRow = max(nativeLastRow, (end - 1) / kMatrixWidth);
+  }
+  nativeFrame++;
+  nativeFrameDelay = frame.frameDelay;
+  return spans.isValid();
+}
+
+// Show the next .pnd frame once it's due, no SPIFFS reads or drawing beyond the pixels it changes
+void GifPlayer::updateNative(){
+  if(!clock.isDue()){
+    return;
+  }
+
+  int frameCount = nativeHeader.frameCount;
+  int frame = (nativeFrame + 1 < frameCount) ? nativeFrame + 1 : 0;
+  bool requested = requestedFrame >= 0;
+  if(requested){
+    frame = min(requestedFrame, frameCount - 1);
+    requestedFrame = -1;
+  }
+
+  if(!requested && frame <= nativeFrame && startNextLoop()){
+    return;
+  }
+
+  #ifdef DEBUG_DRAW_CYCLES
+  uint32_t startCycles = ESP.getCycleCount();
+  #endif
+  GIF_STATS_ENTER(stats, GIF_STAGE_OUTPUT);
+
+  // going back starts over on the blank canvas, frames before the one due aren't shown
+  if(frame <= nativeFrame){
+    rewindNative();
+  }
+  bool valid = true;
+  while(valid && nativeFrame < frame){
+    valid = readNativeFrame();
+  }
+
+  // frames that would be over before they could be shown are skipped, within the loop
+  while(valid && nativeFrame + 1 < frameCount && clock.isOver(nativeFrameDelay)){
+    clock.advance(nativeFrameDelay);
+    valid = readNativeFrame();
+    GIF_STATS_DROPPED(stats);
+  }
+
+  if(!valid){
+    Serial.println("Broken pnd, playing the gif instead: " + currentFilename);
+    nativeFile.close();
+    native = false;
+    SPIFFS.remove(getPndPath("/gifs/" + currentFilename));
+    loadFrameIndex();
+    startDecoding();
+    return;
+  }
+
+  #ifdef DEBUG_DRAW_CYCLES
+  Serial.printf(">>> pnd draw cycles: %u\n", ESP.getCycleCount() - startCycles);
+  #endif
+
+  framesShown++;
+  clock.advance(nativeFrameDelay);
+  showLeds(0, nativeFirstRow, kMatrixWidth, max(nativeLastRow - nativeFirstRow + 1, 0));
+  nativeFirstRow = kMatrixHeight;
+  nativeLastRow = -1;
+}
+
+void GifPlayer::convertNativePalette(){
+  for(int i = 0; i < nativeHeader.colorCount; i++){
+    uint32_t color = nativePalette[i];
+    nativeColors[i] = toOutputColor(color >> 24, color >> 16, color >> 8);
+  }
+}
+
+// Every led from nativeCanvas, shown with the next frame
+void GifPlayer::drawNativeCanvas(){
+  for(int i = 0; i < NUM_LEDS; i++){
+    leds[XYTable[i]] = nativeColors[nativeCanvas[i]];
+  }
+  if(alpha){
+    for(int i = 0; i < NUM_LEDS; i++){
+      alpha[XYTable[i]] = nativePalette[nativeCanvas[i]];
+    }
+  }
+  nativeFirstRow = 0;
+  nativeLastRow = kMatrixHeight - 1;
+}
+
+void GifPlayer::loadFrameIndex(){
+  decoder.setFrameIndex(frameIndex, MAX_INDEXED_FRAMES);
+  frameIndexSaved = false;
+
+  String path = getFrameIndexPath("/gifs/" + currentFilename);
+  if(!SPIFFS.exists(path)){
+    return;
+  }
+
+  // header: magic, gif file size, frame count
+  uint32_t header[3];
+  File file = SPIFFS.open(path, "r");
+  bool valid = file.read((uint8_t *)header, sizeof(header)) == sizeof(header)
+            && header[0] == FRAME_INDEX_MAGIC
+            && header[1] == getCurrentFileSize()
+            && header[2] > 0 && header[2] <= MAX_INDEXED_FRAMES;
+  if(valid){
+    size_t size = header[2] * sizeof(gif_frame_info);
+    valid = file.read((uint8_t *)frameIndex, size) == size;
+  }
+  file.close();
+
+  if(valid){
+    decoder.setFrameIndex(frameIndex, MAX_INDEXED_FRAMES, header[2]);
+    frameIndexSaved = true;
+  }else{
+    Serial.println("Ignored stale frame index: " + path);
+  }
+}
+
+void GifPlayer::saveFrameIndex(){
+  // only try once per file
+  frameIndexSaved = true;
+
+  String path = getFrameIndexPath("/gifs/" + currentFilename);
+  File file = SPIFFS.open(path, "w");
+  if(!file){
+    Serial.println("Can not write frame index: " + path);
+    return;
+  }
+  uint32_t header[3] = { FRAME_INDEX_MAGIC, (uint32_t)getCurrentFileSize(), (uint32_t)decoder.getFrameCount() };
+  file.write((uint8_t *)header, sizeof(header));
+  file.write((uint8_t *)frameIndex, header[2] * sizeof(gif_frame_info));
+  file.close();
 }
 
 File & GifPlayer::getCurrentFile(){
-  return filemap[currentFilename];
+  return currentFile;
+}
+
+size_t GifPlayer::getCurrentFileSize(){
+  return packedGif ? packedGifSize : currentFile.size();
+}
+
+// Find currentFilename on SPIFFS or else in the gif pack, false when it's in neither
+bool GifPlayer::openCurrentFile(){
+  std::map<String, File>::iterator itr = filemap.find(currentFilename);
+  currentFile = (itr != filemap.end()) ? itr->second : File();
+  packedGif = currentFile ? NULL : pack.find(currentFilename.c_str(), packedGifSize);
+  decoder.setFileData(packedGif, packedGifSize);
+  return currentFile || packedGif;
+}
+
+// LED setup, once for all players, leds already hold output colors in COLOR_ORDER
+void GifPlayer::setupLeds(){
+    FastLED.addLeds < CHIPSET, LED_PIN, RGB > (::leds, NUM_LEDS);
+    FastLED.setBrightness(255);
+    FastLED.setDither(DISABLE_DITHER);
+    FastLED.clear(true);
 }
 
 void GifPlayer::setup(){
@@ -147,61 +1006,318 @@ void GifPlayer::setup(){
     loadGifFiles();
 
     // setup gif decoder callbacks and start decoding
+    decoder.setCallbackUser(this);
     decoder.setScreenClearCallback(screenClearCallback);
-    decoder.setUpdateScreenCallback(updateScreenCallback);
     decoder.setDrawPixelCallback(drawPixelCallback);
+    decoder.setPaletteCallback(paletteCallback);
+    decoder.setScaleMode(GIF_SCALE_MODE);
+    #ifndef DEBUG_DRAW_PIXEL_CALLBACK_ONLY
+    decoder.setDrawRowCallback(drawRowCallback);
+    #endif
+    #ifdef DEBUG_DRAW_CYCLES
+    decoder.setStartDrawingCallback(startDrawingCallback);
+    #endif
     decoder.setFileSeekCallback(fileSeekCallback);
     decoder.setFilePositionCallback(filePositionCallback);
     decoder.setFileReadCallback(fileReadCallback);
     decoder.setFileReadBlockCallback(fileReadBlockCallback);
-    decoder.startDecoding();
-
-    // LED setup
-    FastLED.addLeds < CHIPSET, LED_PIN, COLOR_ORDER > (leds, NUM_LEDS).setCorrection(TypicalSMD5050);
-    FastLED.setBrightness(brightness);
-    FastLED.clear(true);
+    decoder.setFrameSnapshots(frameSnapshots, FRAME_SNAPSHOTS, FRAME_SNAPSHOT_INTERVAL);
+    clock.setMinFrameTime(MIN_FRAME_TIME);
+    decoder.setClock(&clock);
+    updateOutputTables();
+    openCurrentFile();
+    startPlaying();
 }
 
 void GifPlayer::update(){
+
+  // convert uploaded gifs between frames, one per call
+  if(!pendingNative.empty()){
+    String filename = *pendingNative.begin();
+    pendingNative.erase(pendingNative.begin());
+    encodeNative(filename);
+  }
     
-  if(filemap.find(currentFilename) != filemap.end()){
+  if(currentFile || packedGif){
     //Serial.println(currentFilename);
-    decoder.decodeFrame();
+
+    if(native){
+      updateNative();
+      return;
+    }
+
+    // show the decoded frame when it's due, the next one is decoded right after
+    // so the time in between is free for the server
+    if(decoder.isFramePending()){
+      if(decoder.getTimeToNextFrame() > 0){
+        return;
+      }
+      int frame = decoder.getCurrentFrame();
+      if(frame <= shownFrame && startNextLoop()){
+        return;
+      }
+      decoder.presentFrame();
+      shownFrame = frame;
+      framesShown++;
+      int x, y, width, height;
+      decoder.getDirtyRect(x, y, width, height);
+      showLeds(x, y, width, height);
+    }
+
+    if(frameCacheState == CACHE_READY){
+      updateFromCache();
+      return;
+    }
+
+    int result;
+    if(requestedFrame >= 0){
+      result = decoder.decodeFrameAt(requestedFrame);
+      if(result != ERROR_WAITING){
+        requestedFrame = -1;
+        shownFrame = -1;
+      }
+    }else if(playMode == PLAY_FORWARD || !decoder.isFrameIndexComplete()){
+      // the first pass in order builds the frame index
+      result = decoder.decodeFrame();
+    }else{
+      result = decoder.decodeFrameAt(getNextFrame(decoder.getCurrentFrame(), decoder.getFrameCount()));
+    }
+
+    if(result == ERROR_NONE){
+      #ifdef DEBUG_DRAW_CYCLES
+      // drawing is the last thing a decode does
+      Serial.printf(">>> draw cycles: %u\n", ESP.getCycleCount() - drawStartCycles);
+      #endif
+      frameCacheMisses++;
+      cacheFrame();
+    }
+
+    if(!frameIndexSaved && decoder.isFrameIndexComplete()){
+      saveFrameIndex();
+    }
+
+    // all frames are cached once the frame index knows how many there are
+    if(frameCacheState == CACHE_FILLING && decoder.isFrameIndexComplete()
+      && (int)frameCacheFrames.size() == decoder.getFrameCount()){
+      frameCacheState = CACHE_READY;
+      frameCacheFrame = frameCacheFrames.size() - 1;
+      // nothing is added from now on, give back what growing reserved
+      frameCacheData.shrink_to_fit();
+      frameCachePalette.shrink_to_fit();
+      frameCacheFrames.shrink_to_fit();
+      #ifdef DEBUG_FRAME_CACHE
+      Serial.printf(">>> frame cache ready, %i frames, %u bytes\n", (int)frameCacheFrames.size(), (unsigned)getFrameCacheBytes());
+      #endif
+    }
+
+    #ifdef DEBUG_FILE_CALLBACKS_PER_FRAME
+    Serial.printf(">>> file callbacks per frame: %i\n", decoder.getFileCallbacksPerFrame());
+    #endif
   }else{
     
     Serial.println("Error, can not find file: " + currentFilename);
   }
 }
 
-void GifPlayer::screenClearCallback() {
+void GifPlayer::screenClearCallback(void * user) {
   #ifdef DEBUG_SCREEN_CLEAR_CALLBACK
   Serial.println(">>> screenClearCallback");
   #endif
-  FastLED.clear();
+  GifPlayer * player = (GifPlayer *)user;
+  memset((void *)player->leds, 0, NUM_LEDS * sizeof(CRGB));
+  if(player->alpha){
+    memset(player->alpha, 0, NUM_LEDS);
+  }
 }
 
-void GifPlayer::updateScreenCallback(){
-  #ifdef DEBUG_UPDATE_SCREEN_CALLBACK
-  Serial.println(">>> updateScreenCallback");
-  #endif
-  FastLED.show();
+// Show the leds unless nothing on the mask changed inside the given matrix rectangle
+void GifPlayer::showLeds(int x, int y, int width, int height){
+  GIF_STATS_ENTER(stats, GIF_STAGE_SHOW);
+  // a layer hands every frame to the compositor, which shows them
+  if(layer){
+    (*frameCallback)(frameCallbackUser);
+  }else if(!updateShownLeds(x, y, width, height)){
+    skippedShows++;
+  }else if(pipeline){
+    pipeline->present(leds);
+  }else{
+    FastLED.show();
+  }
+  GIF_STATS_END_FRAME(stats);
+}
+
+// Copy the leds in the rect to shownLeds, false when none of them changed
+bool GifPlayer::updateShownLeds(int x, int y, int width, int height){
+  bool changed = false;
+  for(int j = y; j < y + height; j++){
+    const uint16_t * map = &XYTable[(j * kMatrixWidth) + x];
+    for(int i = 0; i < width; i++){
+      if(leds[map[i]] != shownLeds[map[i]]){
+        shownLeds[map[i]] = leds[map[i]];
+        changed = true;
+      }
+    }
+  }
+  return changed;
 }
 
-void GifPlayer::drawPixelCallback(int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue){
+void GifPlayer::drawPixelCallback(void * user, int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue){
   #ifdef DEBUG_DRAW_PIXEL_CALLBACK
   Serial.printf(">>> drawPixelCallback, pos(%i, %i), color(%i, %i, %i)\n", x, y, red, green, blue);
   #endif
 
-  leds[XY(x,y)] = CRGB(red, green, blue);
+  GifPlayer * player = (GifPlayer *)user;
+  player->leds[XY(x,y)] = player->toOutputColor(red, green, blue);
+  if(player->alpha){
+    player->alpha[XY(x,y)] = 255;
+  }
+}
+
+void GifPlayer::drawRowCallback(void * user, int16_t x, int16_t y, const uint8_t * indices, int16_t width, const rgb_24 * palette, int16_t transparentIndex){
+  ((GifPlayer *)user)->drawRow(x, y, indices, width, transparentIndex);
+}
+
+void GifPlayer::drawRow(int16_t x, int16_t y, const uint8_t * indices, int16_t width, int16_t transparentIndex){
+  // every led of the mask is in XYTable, clip instead of drawing to a "hidden" one
+  if(y >= kMatrixHeight || x >= kMatrixWidth){
+    return;
+  }
+  if(x + width > kMatrixWidth){
+    width = kMatrixWidth - x;
+  }
+
+  // the decoder's palette, paletteCallback() has converted it to outputPalette
+  const uint16_t * map = &XYTable[(y * kMatrixWidth) + x];
+  if(transparentIndex == NO_TRANSPARENT_INDEX){
+    // the decoder splits rows of transparent frames into spans, most of them all opaque
+    for(int i = 0; i < width; i++){
+      leds[map[i]] = outputPalette[indices[i]];
+      if(alpha){
+        alpha[map[i]] = 255;
+      }
+    }
+    return;
+  }
+  if(alpha){
+    // transparent pixels keep what's under them, which is alpha 0 after a screen clear
+    for(int i = 0; i < width; i++){
+      if(indices[i] != transparentIndex){
+        leds[map[i]] = outputPalette[indices[i]];
+        alpha[map[i]] = 255;
+      }
+    }
+    return;
+  }
+  for(int i = 0; i < width; i++){
+    if(indices[i] != transparentIndex){
+      leds[map[i]] = outputPalette[indices[i]];
+    }
+  }
 }
 
-bool GifPlayer::fileSeekCallback(unsigned long position){
+void GifPlayer::paletteCallback(void * user, const rgb_24 * palette, int colorCount){
+  ((GifPlayer *)user)->convertPalette(palette, colorCount);
+}
+
+// Convert the palette entries that changed since the color table was converted last,
+// going back to the global table after a frame with a local one converts nothing
+void GifPlayer::convertPalette(const rgb_24 * palette, int colorCount){
+  // the slot of this table, or the one frames aren't drawn with
+  int slot = 0;
+  if(convertedPalettes[0].palette != palette){
+    slot = (convertedPalettes[1].palette == palette || outputPalette == convertedPalettes[0].colors) ? 1 : 0;
+  }
+  ConvertedPalette & converted = convertedPalettes[slot];
+  converted.palette = palette;
+  for(int i = 0; i < colorCount; i++){
+    if(i < converted.count && memcmp(&converted.raw[i], &palette[i], sizeof(rgb_24)) == 0){
+      continue;
+    }
+    converted.raw[i] = palette[i];
+    converted.colors[i] = toOutputColor(palette[i].red, palette[i].green, palette[i].blue);
+  }
+  converted.count = max(converted.count, colorCount);
+  outputPalette = converted.colors;
+}
+
+void GifPlayer::updateOutputTables(){
+  if(!layer){
+    fillOutputTables(outputTables, brightness);
+    return;
+  }
+  // the compositor converts after blending, layers keep the gif's colors
+  for(int c = 0; c < 3; c++){
+    for(int i = 0; i < 256; i++){
+      outputTables[c][i] = i;
+    }
+  }
+}
+
+CRGB GifPlayer::toOutputColor(uint8_t red, uint8_t green, uint8_t blue){
+  CRGB color(outputTables[0][red], outputTables[1][green], outputTables[2][blue]);
+  return layer ? color : toColorOrder(color);
+}
+
+void GifPlayer::setBrightness(uint8_t value){
+  brightness = value;
+  updateOutputTables();
+  for(int slot = 0; slot < 2; slot++){
+    ConvertedPalette & converted = convertedPalettes[slot];
+    for(int i = 0; i < converted.count; i++){
+      converted.colors[i] = toOutputColor(converted.raw[i].red, converted.raw[i].green, converted.raw[i].blue);
+    }
+  }
+
+  // cached frames hold output colors
+  resetFrameCache();
+
+  if(native){
+    convertNativePalette();
+    drawNativeCanvas();
+  }
+}
+
+// Playback speed from 0.25 to 4, frame delays are divided by it
+void GifPlayer::setSpeed(float speed){
+  clock.setSpeed(speed);
+}
+
+// Play as a compositor layer, call before setup(). Frames go to target with plain gif colors and
+// alpha 0 where the gif is transparent, frameCallback replaces FastLED.show() once a frame is due.
+void GifPlayer::setLayerOutput(CRGB * target, uint8_t * alpha, callback frameCallback, void * user){
+  layer = true;
+  leds = target;
+  this->alpha = alpha;
+  this->frameCallback = frameCallback;
+  frameCallbackUser = user;
+  memset(alpha, 0, NUM_LEDS);
+}
+
+// Hand shown frames to a pipeline of NUM_LEDS CRGBs, its show task puts them on the leds.
+// target must not be ::leds then, the player draws the next frame while the last is shown.
+void GifPlayer::setPipeline(FramePipeline * pipeline){
+  this->pipeline = pipeline;
+}
+
+#if GIF_STATS
+// Time decoding and showing frames, stats can be shared with other players
+void GifPlayer::setStats(GifStats * stats){
+  this->stats = stats;
+  decoder.setStats(stats);
+}
+#endif
+
+void GifPlayer::startDrawingCallback(void * user){
+  ((GifPlayer *)user)->drawStartCycles = ESP.getCycleCount();
+}
+
+bool GifPlayer::fileSeekCallback(void * user, unsigned long position){
   #ifdef DEBUG_FILE_SEEK_CALLBACK
   Serial.print(">>> fileSeekCallback  ");
   Serial.print("position: ");
   Serial.print (position);
   #endif
-  bool r = getCurrentFile().seek(position);
+  bool r = ((GifPlayer *)user)->currentFile.seek(position);
   #ifdef DEBUG_FILE_SEEK_CALLBACK
   Serial.print(", r ");
   Serial.println(r);
@@ -209,28 +1325,28 @@ bool GifPlayer::fileSeekCallback(unsigned long position){
   return r;
 }
 
-unsigned long GifPlayer::filePositionCallback(){
+unsigned long GifPlayer::filePositionCallback(void * user){
   #ifdef DEBUG_FILE_POSITION_CALLBACK
   Serial.println(">>> filePositionCallback  ");
   #endif
-  return getCurrentFile().position();
+  return ((GifPlayer *)user)->currentFile.position();
 }
 
-int GifPlayer::fileReadCallback(){
+int GifPlayer::fileReadCallback(void * user){
   #ifdef DEBUG_FILE_READ_CALLBACK
   Serial.println(">>> fileReadCallback");
   #endif
-  return getCurrentFile().read();
+  return ((GifPlayer *)user)->currentFile.read();
 }
 
-int GifPlayer::fileReadBlockCallback(void * buffer, int numberOfBytes){
+int GifPlayer::fileReadBlockCallback(void * user, void * buffer, int numberOfBytes){
   #ifdef DEBUG_FILE_READ_BLOCK_CALLBACK
   Serial.print(">>> fileReadBlockCallback  ");
   Serial.print("numberOfBytes: ");
   Serial.println(numberOfBytes);
   #endif
 
-  int num_read = getCurrentFile().read((uint8_t *)buffer, numberOfBytes);
+  int num_read = ((GifPlayer *)user)->currentFile.read((uint8_t *)buffer, numberOfBytes);
 
   #ifdef DEBUG_FILE_READ_BLOCK_CALLBACK
   Serial.print(", read ");
@@ -241,3 +1357,20 @@ int GifPlayer::fileReadBlockCallback(void * buffer, int numberOfBytes){
 
   return num_read;
 }
+
+// File callbacks of the encoder, user is the gif's File
+bool GifPlayer::nativeFileSeekCallback(void * user, unsigned long position){
+  return ((File *)user)->seek(position);
+}
+
+unsigned long GifPlayer::nativeFilePositionCallback(void * user){
+  return ((File *)user)->position();
+}
+
+int GifPlayer::nativeFileReadCallback(void * user){
+  return ((File *)user)->read();
+}
+
+int GifPlayer::nativeFileReadBlockCallback(void * user, void * buffer, int numberOfBytes){
+  return ((File *)user)->read((uint8_t *)buffer, numberOfBytes);
+}
@@ -37,6 +37,35 @@ std::string getFilename(std::string filepath){
   return filepath.substr(filepath.find_last_of("/\\") + 1);
 }
 
+// Frame index sidecar file stored next to a gif
+String getFrameIndexPath(String gifPath){
+  return gifPath + ".idx";
+}
+
+// Pre-decoded .pnd stored next to a gif, see PndEncoder.h
+String getPndPath(String gifPath){
+  return gifPath + ".pnd";
+}
+
 void replaceWhitespace(std::string & str){
     std::replace(str.begin(), str.end(), ' ', '_');        
 }
+
+// Quotes, backslashes and control characters escaped for a JSON string
+String jsonEscape(String str){
+  String escaped = "";
+  for(unsigned int i = 0; i < str.length(); i++){
+    char c = str[i];
+    if(c == '"' || c == '\\'){
+      escaped += '\\';
+      escaped += c;
+    }else if((uint8_t)c < 0x20){
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    }else{
+      escaped += c;
+    }
+  }
+  return escaped;
+}
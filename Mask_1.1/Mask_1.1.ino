@@ -1,8 +1,25 @@
+// Time every stage of every frame, sending 's' over serial prints them, see GifStats.h [0]
+#define GIF_STATS  0
+
 #include "GifPlayer.h"
 #include "PandaWebServer.h"
 
-GifPlayer gifPlayer;
+#define SHOW_TASK  true  // Show frames on the other core while loop() decodes the next one [true]
+
+// Frames are drawn here, the show task copies them to leds
+CRGB canvas[NUM_LEDS];
+GifPlayer gifPlayer(canvas);
+FramePipeline pipeline(sizeof(canvas));
 PandaWebServer server;
+#if GIF_STATS
+GifStats gifStats;
+#endif
+
+// Runs on the show task, or right in loop() without one
+void showFrame(void * user, const uint8_t * frame){
+  memcpy(leds, frame, sizeof(leds));
+  FastLED.show();
+}
 
 // Callback When server receive play request e.g. /play?test.gif
 // then we change gifPlayer's currentFilename
@@ -11,21 +28,51 @@ void gifPlayCallback(String filename){
   gifPlayer.setCurrentFilename(filename);
 }
 
+// Callback when an upload finished, the player plays a pnd made from the gif
+// Gifs it can't play are turned down
+bool gifUploadCallback(String filename){
+  return gifPlayer.addGif(filename);
+}
+
+// Callback for /list?info, what probing found out about a gif
+bool gifInfoCallback(String filename, gif_info & info){
+  return gifPlayer.getGifInfo(filename, info);
+}
+
 void setup() {
   Serial.begin(57600);
   Serial.println("start setup()...");
 
+  GifPlayer::setupLeds();
+  pipeline.setShowCallback(showFrame, NULL);
+  if(SHOW_TASK){
+    pipeline.begin();
+  }
+  gifPlayer.setPipeline(&pipeline);
+  #if GIF_STATS
+  gifPlayer.setStats(&gifStats);
+  #endif
   gifPlayer.setup();
 
   server.setup();
   server.setGifPlayCallback(gifPlayCallback);
+  server.setGifUploadCallback(gifUploadCallback);
+  server.setGifInfoCallback(gifInfoCallback);
 
   Serial.println("end setup()...");
 }
 
 void loop() {
+  // neither call blocks, the player returns right away until its next frame is due
+  // and the show task takes the frame while the player decodes the one after it
   server.update();
   gifPlayer.update();
+
+  #if GIF_STATS
+  if(Serial.available() && Serial.read() == 's'){
+    gifStats.print();
+  }
+  #endif
 }
 
 
@@ -8,8 +8,11 @@
 #include "SPIFFS.h"
 #include <string>
 #include "Helper.h"
+#include "GifDecoder.h"
 
 typedef void (*gif_play_callback)(String filename);
+typedef bool (*gif_upload_callback)(String filename);
+typedef bool (*gif_info_callback)(String filename, gif_info & info);
 
 class PandaWebServer{
 
@@ -23,9 +26,16 @@ public:
     static bool handleFileRead(String path);
     static void handleGifUpload();
     static void handleGifList();
+    static String getGifInfoJson(String filename);
 
     void setGifPlayCallback(gif_play_callback cb);
     static gif_play_callback gifPlayCallback;
+    // Called once an uploaded gif is complete, false deletes it again
+    void setGifUploadCallback(gif_upload_callback cb);
+    static gif_upload_callback gifUploadCallback;
+    // What probing found out about a gif, /list?info sends it along with the names
+    void setGifInfoCallback(gif_info_callback cb);
+    static gif_info_callback gifInfoCallback;
 
     const char* ssid     = "yourssid";
     const char* password = "yourpasswd";
@@ -33,6 +43,7 @@ public:
     static WebServer server;
     //static AsyncWebServer server;
     static File fsUploadFile;
+    static String uploadError;
 
     static String gifRoot;
 };
@@ -40,9 +51,12 @@ public:
 WebServer PandaWebServer::server;
 //AsyncWebServer PandaWebServer::server;
 File PandaWebServer::fsUploadFile;
+String PandaWebServer::uploadError;
 String PandaWebServer::gifRoot = "/gifs";
 
 gif_play_callback PandaWebServer::gifPlayCallback;
+gif_upload_callback PandaWebServer::gifUploadCallback = NULL;
+gif_info_callback PandaWebServer::gifInfoCallback = NULL;
 
 
 void PandaWebServer::setup(){
@@ -104,6 +118,10 @@ void PandaWebServer::setup(){
     server.on("/list", HTTP_GET, handleGifList);
     server.on("/delete", HTTP_DELETE, handleGifDelete);
     server.on("/upload", HTTP_POST, []() {
+        if (uploadError != "") {
+            server.send(500, "text/plain", uploadError);
+            return;
+        }
         server.send(200, "text/plain", "{\"success\":1}");
     }, handleGifUpload);
     // called when the url is not defined
@@ -126,6 +144,14 @@ void PandaWebServer::setGifPlayCallback(gif_play_callback cb){
     gifPlayCallback = cb;
 }
 
+void PandaWebServer::setGifUploadCallback(gif_upload_callback cb){
+    gifUploadCallback = cb;
+}
+
+void PandaWebServer::setGifInfoCallback(gif_info_callback cb){
+    gifInfoCallback = cb;
+}
+
 void PandaWebServer::handleGifPlay(){
     if (server.args() == 0) {
         server.send(500, "text/plain", "BAD ARGS!");
@@ -181,6 +207,8 @@ void PandaWebServer::handleGifDelete() {
         return;
     } 
     SPIFFS.remove(path);
+    SPIFFS.remove(getFrameIndexPath(path));
+    SPIFFS.remove(getPndPath(path));
     Serial.println("deleted");
     String msg = "deleted file: " + path;
     server.send(200, "text/plain", msg);
@@ -209,6 +237,7 @@ void PandaWebServer::handleGifUpload() {
     HTTPUpload& upload = server.upload();
 
     if (upload.status == UPLOAD_FILE_START) {
+        uploadError = "";
 
         // whitespace causes trouble so we replace it into underline '_'
         std::string str = std::string(upload.filename.c_str());
@@ -218,23 +247,40 @@ void PandaWebServer::handleGifUpload() {
         
         String contentType = getContentType(filename);
         if(contentType != "image/gif"){
-            server.send(500, "text/plain", "Prohibited to upload non-gif file!");
+            uploadError = "Prohibited to upload non-gif file!";
             Serial.println("Prohibited to upload non-gif file");
             return;
         }
         String path = gifRoot + "/" + filename;
         Serial.println("handleFileUpload Name: " + path);
         fsUploadFile = SPIFFS.open(path, "w");
+
+        // frame index and pnd of a previous upload with the same name are stale now
+        SPIFFS.remove(getFrameIndexPath(path));
+        SPIFFS.remove(getPndPath(path));
     } else if (upload.status == UPLOAD_FILE_WRITE) {
         if (fsUploadFile){
             fsUploadFile.write(upload.buf, upload.currentSize);
         }
     } else if (upload.status == UPLOAD_FILE_END) {
+        Serial.print("handleFileUpload Size: "); 
+        Serial.println(upload.totalSize);
         if (fsUploadFile){
             fsUploadFile.close();
+
+            // the gif stays for the web preview, the player gets a pnd made from it
+            // gifs the player turns down are deleted again
+            if (gifUploadCallback){
+                std::string str = std::string(upload.filename.c_str());
+                replaceWhitespace(str);
+                String filename(str.c_str());
+                if (!gifUploadCallback(filename)){
+                    SPIFFS.remove(gifRoot + "/" + filename);
+                    uploadError = "Can not play " + filename;
+                    Serial.println(uploadError);
+                }
+            }
         }
-        Serial.print("handleFileUpload Size: "); 
-        Serial.println(upload.totalSize);
     }
 
     // TODO
@@ -242,7 +288,23 @@ void PandaWebServer::handleGifUpload() {
     
 }
 
+// A gif for /list?info, gifs the player can't play only have a name
+String PandaWebServer::getGifInfoJson(String filename){
+    String json = "{\"name\":\"" + jsonEscape(filename) + "\"";
+    gif_info info;
+    if (gifInfoCallback(filename, info)){
+        json += ",\"width\":" + String(info.width);
+        json += ",\"height\":" + String(info.height);
+        json += ",\"frames\":" + String(info.frameCount);
+        json += ",\"duration\":" + String(info.duration_ms);
+        json += ",\"loops\":" + String(info.loopCount);
+    }
+    return json + "}";
+}
+
+// Comma separated names, /list?info sends a JSON array with what probing found out instead
 void PandaWebServer::handleGifList() {
+    bool info = server.hasArg("info") && gifInfoCallback;
     String output = "";
     String path = gifRoot;
 
@@ -252,19 +314,33 @@ void PandaWebServer::handleGifList() {
         File file = dir.openNextFile();
         while (file)
         {
+            std::string filepath = file.name();
+            std::string filename = getFilename(filepath);
+
+            // skip frame index sidecar files
+            if (getContentType(String(filename.c_str())) != "image/gif"){
+                file.close();
+                file = dir.openNextFile();
+                continue;
+            }
+
             // Separate by comma if there are multiple files
             if (output != ""){
                 output += ",";
             }
 
-            std::string filepath = file.name();
-            std::string filename = getFilename(filepath);
-                        
-            output += String(filename.c_str());
+            if (info){
+                output += getGifInfoJson(String(filename.c_str()));
+            }else{
+                output += String(filename.c_str());
+            }
             file.close();
             file = dir.openNextFile();
         }
     }
+    if (info){
+        output = "[" + output + "]";
+    }
     Serial.println(output);        
-    server.send(200, "text/plain", output);
+    server.send(200, info ? "application/json" : "text/plain", output);
 }
@@ -126,7 +126,8 @@
             for (let i = 0; i < fileList.length; i++) {
 
                 //let filePath = "./gifs/test.gif";
-                let filename = fileList[i];
+                let info = fileList[i];
+                let filename = info.name;
                 filename = filename.split(' ').join('_');
 
                 let item = document.createElement("div");
@@ -144,6 +145,17 @@
                 header.innerText = filename;
                 content.appendChild(header);
 
+                // gifs the player can't play come without size
+                let description = document.createElement("div");
+                description.classList.add("description");
+                if (info.frames !== undefined) {
+                    description.innerText = info.width + "x" + info.height + ", " + info.frames + " frames, "
+                        + (info.duration / 1000) + " s";
+                } else {
+                    description.innerText = "can not be played";
+                }
+                content.appendChild(description);
+
                 let playBtn = document.createElement("div");
                 playBtn.classList.add("ui", "right", "floated", "blue", "button");
                 playBtn.innerText = "play";
@@ -173,13 +185,13 @@
         }
 
         let listReq = new XMLHttpRequest();
-        listReq.open("get", "/list", true);
+        listReq.open("get", "/list?info", true);
         listReq.onreadystatechange = function () {
             if (listReq.readyState == XMLHttpRequest.DONE) {
                 console.log("/list\n" + listReq.responseText);
-                //let response = "test.gif,test1.gif,test2.gif,test3.gif";
+                //let response = '[{"name":"test.gif","width":17,"height":17,"frames":9,"duration":1800,"loops":0}]';
                 let response = listReq.responseText;
-                let fileList = response.split(',');
+                let fileList = JSON.parse(response);
                 generate(fileList);
             }
         }
@@ -0,0 +1,257 @@
+#pragma once
+#include "GifPlayer.h"
+
+//#define DEBUG_COMPOSITOR_CYCLES      // cycles spent flattening each frame
+
+#define COMPOSITOR_MAX_LAYERS   8     // Layers a compositor can hold
+#define COMPOSITOR_FPS          60    // Frames flattened and shown per second [60]
+
+// A picture the compositor blends with the layers under it. pixels are in led
+// order like leds, plain colors without brightness, gamma or color order.
+class Layer{
+
+public:
+
+    enum BlendMode { BLEND_NORMAL, BLEND_ADD, BLEND_MULTIPLY, BLEND_SCREEN };
+
+    virtual ~Layer(){}
+    virtual void setup(){}
+    // Called from every loop(), must return right away unless there's work due
+    virtual void update(){}
+    // Called before every compositor frame, time is millis()
+    virtual void render(unsigned long time_ms){}
+
+    CRGB pixels[NUM_LEDS];
+    const uint8_t * alpha = NULL;   // Per led alpha, NULL when the layer is opaque
+    uint8_t opacity = 255;
+    BlendMode blendMode = BLEND_NORMAL;
+    bool visible = true;
+};
+
+// One color, optionally shaped by a mask of per led alpha
+class FillLayer : public Layer{
+
+public:
+
+    FillLayer(CRGB color, const uint8_t * mask = NULL){
+      setColor(color);
+      alpha = mask;
+    }
+
+    void setColor(CRGB color){
+      for(int i = 0; i < NUM_LEDS; i++){
+        pixels[i] = color;
+      }
+    }
+};
+
+// Procedural pattern, draws pixels for the given millis() on every compositor frame
+typedef void (*pattern_callback)(void * user, CRGB * pixels, unsigned long time_ms);
+
+class PatternLayer : public Layer{
+
+public:
+
+    PatternLayer(pattern_callback pattern, void * user = NULL) : pattern(pattern), user(user){}
+
+    void render(unsigned long time_ms){
+      (*pattern)(user, pixels, time_ms);
+    }
+
+    pattern_callback pattern;
+    void * user;
+};
+
+// A GifPlayer, transparent gif pixels have alpha 0. The player decodes ahead into
+// its own buffers, frames are copied to pixels once they are due.
+class GifLayer : public Layer{
+
+public:
+
+    GifLayer(){
+      player.setLayerOutput(decodedLeds, decodedAlpha, frameCallback, this);
+      memset(frameAlpha, 0, NUM_LEDS);
+      alpha = frameAlpha;
+    }
+
+    void setup(){
+      player.setup();
+    }
+
+    void update(){
+      player.update();
+    }
+
+    static void frameCallback(void * user){
+      GifLayer * layer = (GifLayer *)user;
+      memcpy((void *)layer->pixels, layer->decodedLeds, sizeof(layer->pixels));
+      memcpy(layer->frameAlpha, layer->decodedAlpha, NUM_LEDS);
+    }
+
+    GifPlayer player;
+    CRGB decodedLeds[NUM_LEDS];
+    uint8_t decodedAlpha[NUM_LEDS];
+    uint8_t frameAlpha[NUM_LEDS];
+};
+
+// Blends layers bottom to top into target and shows it, nothing else calls FastLED.show().
+// Layers are owned by the caller.
+class Compositor{
+
+public:
+
+    Compositor(CRGB * target = ::leds) : leds(target){}
+    void setup();
+    void update();
+    bool addLayer(Layer * layer);
+    void removeLayer(Layer * layer);
+    void setBrightness(uint8_t value);
+    bool flatten();
+    unsigned long getSkippedShows();
+
+    CRGB * leds;
+    // Shows frames on another task, see GifPlayer::setPipeline()
+    FramePipeline * pipeline = NULL;
+    uint8_t brightness = BRIGHTNESS;
+    uint8_t outputTables[3][256];
+
+    Layer * layers[COMPOSITOR_MAX_LAYERS];
+    int layerCount = 0;
+
+    unsigned long nextFrameTime_ms = 0;
+    unsigned long skippedShows = 0;
+};
+
+void Compositor::setup(){
+  fillOutputTables(outputTables, brightness);
+  for(int i = 0; i < layerCount; i++){
+    layers[i]->setup();
+  }
+}
+
+// Layers are added on top of the ones already there
+bool Compositor::addLayer(Layer * layer){
+  if(layerCount == COMPOSITOR_MAX_LAYERS){
+    Serial.println("Can not add layer, compositor is full");
+    return false;
+  }
+  layers[layerCount++] = layer;
+  return true;
+}
+
+void Compositor::removeLayer(Layer * layer){
+  for(int i = 0; i < layerCount; i++){
+    if(layers[i] == layer){
+      memmove(&layers[i], &layers[i + 1], (layerCount - i - 1) * sizeof(Layer *));
+      layerCount--;
+      return;
+    }
+  }
+}
+
+void Compositor::setBrightness(uint8_t value){
+  brightness = value;
+  fillOutputTables(outputTables, brightness);
+}
+
+// Frames with nothing visible changed that needed no FastLED.show()
+unsigned long Compositor::getSkippedShows(){
+  return skippedShows;
+}
+
+void Compositor::update(){
+  for(int i = 0; i < layerCount; i++){
+    layers[i]->update();
+  }
+
+  // signed difference, works across millis() rolling over
+  unsigned long now = millis();
+  if((long)(now - nextFrameTime_ms) < 0){
+    return;
+  }
+  // frames stay on their own beat, a frame or more behind starts over from now
+  nextFrameTime_ms += 1000 / COMPOSITOR_FPS;
+  if((long)(now - nextFrameTime_ms) >= 0){
+    nextFrameTime_ms = now + (1000 / COMPOSITOR_FPS);
+  }
+
+  for(int i = 0; i < layerCount; i++){
+    if(layers[i]->visible){
+      layers[i]->render(now);
+    }
+  }
+
+  #ifdef DEBUG_COMPOSITOR_CYCLES
+  uint32_t startCycles = ESP.getCycleCount();
+  #endif
+  bool changed = flatten();
+  #ifdef DEBUG_COMPOSITOR_CYCLES
+  Serial.printf(">>> flatten cycles: %u\n", ESP.getCycleCount() - startCycles);
+  #endif
+
+  if(!changed){
+    skippedShows++;
+    return;
+  }
+  if(pipeline){
+    pipeline->present(leds);
+  }else if(leds == ::leds){
+    FastLED.show();
+  }
+}
+
+// Blend all visible layers into leds in one pass, 8 bit fixed point per channel.
+// Returns false when no led changed.
+bool Compositor::flatten(){
+  // layers that can't change anything are left out of the pass
+  Layer * active[COMPOSITOR_MAX_LAYERS];
+  int activeCount = 0;
+  for(int i = 0; i < layerCount; i++){
+    if(layers[i]->visible && layers[i]->opacity > 0){
+      active[activeCount++] = layers[i];
+    }
+  }
+
+  bool changed = false;
+  for(int i = 0; i < NUM_LEDS; i++){
+    uint8_t color[3] = { 0, 0, 0 };
+
+    for(int l = 0; l < activeCount; l++){
+      const Layer * layer = active[l];
+      uint8_t a = layer->alpha ? scale8(layer->alpha[i], layer->opacity) : layer->opacity;
+      if(a == 0){
+        continue;
+      }
+
+      const uint8_t * src = layer->pixels[i].raw;
+      uint8_t blended[3];
+      switch(layer->blendMode){
+        case Layer::BLEND_ADD:
+          for(int c = 0; c < 3; c++) blended[c] = qadd8(color[c], src[c]);
+          break;
+        case Layer::BLEND_MULTIPLY:
+          for(int c = 0; c < 3; c++) blended[c] = scale8(color[c], src[c]);
+          break;
+        case Layer::BLEND_SCREEN:
+          for(int c = 0; c < 3; c++) blended[c] = 255 - scale8(255 - color[c], 255 - src[c]);
+          break;
+        default:
+          for(int c = 0; c < 3; c++) blended[c] = src[c];
+          break;
+      }
+      // color + (blended - color) * a, exact for a == 255. Unsigned either way so both
+      // directions round towards color the same
+      for(int c = 0; c < 3; c++){
+        if(blended[c] >= color[c]) color[c] += ((unsigned)(blended[c] - color[c]) * (a + 1)) >> 8;
+        else color[c] -= ((unsigned)(color[c] - blended[c]) * (a + 1)) >> 8;
+      }
+    }
+
+    CRGB out = toColorOrder(CRGB(outputTables[0][color[0]], outputTables[1][color[1]], outputTables[2][color[2]]));
+    if(out != leds[i]){
+      leds[i] = out;
+      changed = true;
+    }
+  }
+  return changed;
+}
@@ -0,0 +1,488 @@
+#ifndef _GIFDECODER_H_
+#define _GIFDECODER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "GifStats.h"
+
+// Every callback gets the pointer given to GifDecoder::setCallbackUser() as its first argument
+typedef void (*callback)(void *user);
+typedef void (*pixel_callback)(void *user, int16_t x, int16_t y, uint8_t red, uint8_t green, uint8_t blue);
+typedef void* (*get_buffer_callback)(void *user);
+
+typedef bool (*file_seek_callback)(void *user, unsigned long position);
+typedef unsigned long (*file_position_callback)(void *user);
+typedef int (*file_read_callback)(void *user);
+typedef int (*file_read_block_callback)(void *user, void * buffer, int numberOfBytes);
+// Time in ms, wraps around like millis()
+typedef unsigned long (*time_callback)(void *user);
+
+typedef struct rgb_24 {
+    uint8_t red;
+    uint8_t green;
+    uint8_t blue;
+} rgb_24;
+
+// A row of width palette indices starting at (x, y), pixels equal to
+// transparentIndex are left alone (-1 when there are none). Rows of frames with
+// transparency come in spans between runs of transparent pixels.
+typedef void (*row_callback)(void *user, int16_t x, int16_t y, const uint8_t *indices, int16_t width, const rgb_24 *palette, int16_t transparentIndex);
+// The first colorCount palette entries were just loaded from a color table
+typedef void (*palette_callback)(void *user, const rgb_24 *palette, int colorCount);
+
+// Frame index entry, see GifDecoder::setFrameIndex()
+typedef struct gif_frame_info {
+    uint32_t filePosition;      // First block belonging to the frame
+    uint16_t frameDelay;        // In 1/100 s
+    uint8_t disposalMethod;
+    uint8_t reserved;
+    int16_t x;
+    int16_t y;
+    int16_t width;
+    int16_t height;
+} gif_frame_info;
+
+// What GifDecoder::probe() finds out about a file without decoding it
+typedef struct gif_info {
+    int width;                  // Logical screen
+    int height;
+    int frameCount;
+    unsigned long duration_ms;  // Of one loop at speed 1 without a minimum frame time
+    int loopCount;              // NETSCAPE2.0 loop count, 0 for forever
+    int maxLzwCodeSize;
+    size_t arenaNeeded;         // Arena startDecoding() needs for the file on this decoder
+} gif_info;
+
+// LZW constants
+// NOTE: the code tables are sized per file, a frame of n pixels can't add more than
+//   n codes, so small gifs need far less than the 4096 entries 12 bit codes allow
+#define LZW_MAXBITS   12
+#define LZW_SIZTABLE  (1 << LZW_MAXBITS)
+
+// Size of the read-ahead buffer all file data is streamed through
+// NOTE: 512 to 4096 bytes works well, every refill is a single fileReadBlockCallback() call
+#ifndef GIF_READ_BUFFER_SIZE
+#define GIF_READ_BUFFER_SIZE  1024
+#endif
+
+// How frames larger than the canvas are handled, see setScaleMode()
+#define GIF_SCALE_NONE      0   // Clip to the canvas
+#define GIF_SCALE_NEAREST   1   // Scale down, nearest neighbour
+#define GIF_SCALE_BOX       2   // Scale down, average of all covered pixels
+
+// Pixels decoded at a time while scaling down
+#ifndef GIF_SCALE_CHUNK_SIZE
+#define GIF_SCALE_CHUNK_SIZE  256
+#endif
+
+// A clock that falls further behind than this many ms starts over
+//   instead of dropping frames to catch up
+#ifndef GIF_MAX_LATENESS
+#define GIF_MAX_LATENESS  1000
+#endif
+
+// Playback timeline, every frame is due once all frames before it were up for
+//   their full delay, however late they were shown
+class GifClock {
+public:
+    GifClock();
+
+    // millis() unless set, e.g. to a fake clock for tests
+    void setTimeCallback(time_callback f, void *user = NULL);
+    unsigned long now(void);
+    // Delays are divided by speed, 0.25 to 4
+    void setSpeed(float speed);
+    float getSpeed(void);
+    // Shortest time a frame is up for, whatever its delay
+    void setMinFrameTime(unsigned long ms);
+
+    // The next frame starts a new timeline whenever it is shown
+    void reset(void);
+    bool isDue(void);
+    // Milliseconds until the next frame is due, 0 when it is
+    unsigned long getTimeToNext(void);
+    // Milliseconds since the next frame was due, 0 before it is
+    unsigned long getLateness(void);
+    // A frame of frameDelay (1/100 s) due next would be over by now
+    bool isOver(int frameDelay);
+    // The frame due next was shown or dropped, the one after it is due frameDelay later
+    void advance(int frameDelay);
+
+private:
+    unsigned long frameTime(int frameDelay, unsigned long &remainder);
+
+    time_callback timeCallback;
+    void *timeCallbackUser;
+    bool running;
+    unsigned long due_ms;
+    unsigned int speed;             // In 1/256
+    unsigned long remainder;        // Fraction of a ms the last frame time was rounded down by
+    unsigned long minFrameTime_ms;
+};
+
+class GifDecoder {
+public:
+    // Decoder state after a frame was composited, see setFrameSnapshots()
+    typedef struct {
+        int frame;              // -1 when unused
+        int prevDisposalMethod;
+        int prevBackgroundIndex;
+        bool prevBackgroundEmpty;
+        int rectX;
+        int rectY;
+        int rectWidth;
+        int rectHeight;
+        uint8_t *imageData;     // In the arena
+        uint8_t *imageDataBU;   // NULL unless the file has disposal method 3 frames
+        uint8_t *emptyPixels;   // NULL like the decoder's
+        uint8_t *emptyPixelsBU;
+    } FrameSnapshot;
+
+    // Gifs are shown on a canvas of at most maxWidth x maxHeight, smaller
+    //   logical screens get a canvas of their own size
+    GifDecoder(int maxWidth, int maxHeight);
+
+    // Memory all buffers are taken from, sized by startDecoding() for the file it opens
+    void setArena(void *arena, size_t size);
+    // Arena bytes the last startDecoding() call needed, when it returned
+    //   ERROR_OUTOFMEMORY call it again after setArena() with at least this much
+    size_t getArenaNeeded(void);
+
+    int startDecoding(void);
+    // Walk the blocks of the file and seek past the image data, nothing is decoded
+    //   and only file callbacks are made. startDecoding() has to be called again after it
+    int probe(gif_info &info);
+    // Decoding a frame only draws it and returns right away, presentFrame() shows it
+    //   once it's due. Both return ERROR_WAITING when called too early
+    int decodeFrame(void);
+    int decodeFrameAt(int frame);
+    int presentFrame(void);
+    bool isFramePending(void);
+    // Milliseconds until the pending frame is due, 0 when it can be shown now
+    unsigned long getTimeToNextFrame(void);
+    // Clock frames are scheduled by, the decoder's own one unless set
+    void setClock(GifClock *clock);
+    GifClock *getClock(void);
+    // decodeFrame() draws frames that would be over before they could be shown
+    //   without presenting them, on by default
+    void setDropLateFrames(bool drop);
+    // Frames dropped since startDecoding()
+    int getDroppedFrames(void);
+#if GIF_STATS
+    // Time spent in each stage of decoding, bytes read, dropped and late frames go to stats
+    void setStats(GifStats *stats);
+#endif
+    
+    // Passed to every callback, e.g. the object the callbacks belong to
+    void setCallbackUser(void *user);
+    void setScreenClearCallback(callback f);
+    void setUpdateScreenCallback(callback f);
+    void setDrawPixelCallback(pixel_callback f);
+    // Draws whole rows instead of single pixels, drawPixelCallback is only used without it
+    void setDrawRowCallback(row_callback f);
+    // Called whenever frames are drawn with another color table or a local one is loaded,
+    //   palette is the decoder's global or local table and stays the same for the global one
+    void setPaletteCallback(palette_callback f);
+    // Scale gifs with a logical screen larger than the canvas down to it, GIF_SCALE_NONE by default
+    void setScaleMode(int mode);
+    void setStartDrawingCallback(callback f);
+
+    // NOTE: all reads go through the read-ahead buffer which is filled by the
+    //   block callback, position and single byte callbacks are only kept for compatibility
+    void setFileSeekCallback(file_seek_callback f);
+    void setFilePositionCallback(file_position_callback f);
+    void setFileReadCallback(file_read_callback f);
+    void setFileReadBlockCallback(file_read_block_callback f);
+    // Read the gif straight from memory instead, e.g. a mapped flash partition, no
+    //   callbacks and no copies into the read-ahead buffer. NULL goes back to the
+    //   callbacks, takes effect with the next startDecoding()
+    void setFileData(const void *data, size_t size);
+
+    // Number of file callbacks made while decoding the last frame
+    int getFileCallbacksPerFrame(void);
+
+    // Optional frame index, filled while frames are decoded in order unless
+    //   knownFrames entries were loaded from elsewhere (e.g. a sidecar file)
+    void setFrameIndex(gif_frame_info *frames, int maxFrames, int knownFrames = 0);
+    // Optional snapshots taken every interval frames so decodeFrameAt() only has to
+    //   decode a few frames, the interval doubles when the snapshots run out
+    //   Their image data is in the arena, takes effect with the next startDecoding()
+    void setFrameSnapshots(FrameSnapshot *snapshots, int count, int interval);
+    int getFrameCount(void);
+    bool isFrameIndexComplete(void);
+    int getCurrentFrame(void);
+    // Delay of the last decoded frame in 1/100 s
+    int getFrameDelay(void);
+    // Times the gif asks to be played in its NETSCAPE2.0 extension, 0 for forever,
+    //   which is also what gifs without the extension get
+    int getLoopCount(void);
+    // Loops decodeFrame() finished since startDecoding()
+    int getLoopsCompleted(void);
+    // Part of the canvas the last decoded frame drew
+    void getDirtyRect(int &x, int &y, int &width, int &height);
+
+private:
+    void resetDecoderState(void);
+    int readFileInfo(bool probing);
+    int scanFrames(void);
+    void *arenaAlloc(size_t &used, size_t size);
+    int layoutArena(void);
+    void saveFrameSnapshot(void);
+    void restoreFrameSnapshot(int slot);
+    void usePalette(rgb_24 *colors, int count, bool loaded = false);
+    void uniteRect(int &x, int &y, int &width, int &height, int x2, int y2, int width2, int height2);
+    void parseTableBasedImage(void);
+    void decompressAndDisplayFrame(void);
+    void streamFrame(void);
+    void drawRow(int16_t x, int16_t y, const uint8_t *indices, int16_t width);
+    void drawCanvasRow(int16_t y);
+    void drawSpan(int16_t x, int16_t y, const uint8_t *indices, int16_t width, int transparentIndex);
+    int skipTransparent(const uint8_t *indices, int i, int width);
+    int findTransparentRun(const uint8_t *indices, int i, int width, bool &gaps);
+    bool isScaling(void);
+    void scaleRect(int &start, int &size, int scaleSize, int canvasSize);
+    int scaleStart(int c, int scaleSize, int canvasSize);
+    int scaleSample(int c, int scaleSize, int canvasSize);
+    void decodeScaledFrame(void);
+    void decodeScaledRow(int canvasY);
+    void storeScaledRow(int canvasY);
+    void clearScaledRow(void);
+    uint8_t closestColorIndex(int red, int green, int blue);
+    int fillInterlacedRows(int rows);
+    int parseData(void);
+    int parseGIFFileTerminator(void);
+    void parseCommentExtension(void);
+    void skipDataSubBlocks(void);
+    void parseApplicationExtension(void);
+    void parseGraphicControlExtension(void);
+    void parsePlainTextExtension(void);
+    void parseGlobalColorTable(void);
+    void parseLogicalScreenDescriptor(void);
+    bool parseGifHeader(void);
+    void copyImageDataRect(uint8_t *dst, uint8_t *src, int x, int y, int width, int height);
+    void fillImageData(uint8_t colorIndex);
+    void fillImageDataRect(uint8_t colorIndex, int x, int y, int width, int height);
+    bool isEmptyPixel(int i);
+    void setEmptyRect(uint8_t *bits, bool empty, int x, int y, int width, int height);
+    void copyEmptyRect(uint8_t *dst, uint8_t *src, int x, int y, int width, int height);
+    void markEmptyPixels(int x, int y, int width, int height);
+    int readIntoBuffer(void *buffer, int numberOfBytes);
+    int readWord(void);
+    void backUpStream(int n);
+    int readByte(void);
+    bool fillReadBuffer(void);
+    void resetReadBuffer(void);
+    unsigned long streamPosition(void);
+    bool seekStream(unsigned long position);
+
+    void lzw_decode_init(int csize);
+    int lzw_decode(uint8_t *buf, int len, uint8_t *bufend);
+    int lzw_decode_rows(uint8_t *buf, int len, int stride, const uint16_t *rowOrder, int rows, uint8_t *bufend);
+    int lzw_get_code(void);
+    void lzw_skip_remaining(void);
+
+    // Canvas limits and the canvas of the current file
+    int maxWidth;
+    int maxHeight;
+    int canvasWidth;
+    int canvasHeight;
+
+    // Caller provided memory and what the current file needs of it
+    uint8_t *arena;
+    size_t arenaSize;
+    size_t arenaNeeded;
+    bool arenaReady;            // Buffers below point into the arena
+
+    // What the file needs, found by scanFrames()
+    bool hasRestoreFrames;      // Some frame uses disposal method 3
+    bool needsCanvas;           // Some frame is transparent or disposed of
+    bool mixedTransparency;     // Frames aren't all transparent with the same index
+    bool hasLocalColorTables;   // Some frame has a color table of its own
+    bool hasInterlacedFrames;
+    long maxFramePixels;
+    int maxFrameWidth;
+    int maxLzwCodeSize;
+    int fileFrameCount;
+    unsigned long fileDuration_ms;
+
+    // Logical screen descriptor attributes
+    int lsdWidth;
+    int lsdHeight;
+    int lsdPackedField;
+    int lsdAspectRatio;
+    int lsdBackgroundIndex;
+
+    // Read once by startDecoding(), every loop only seeks back to firstFramePosition
+    unsigned long firstFramePosition;
+    int globalColorCount;
+    rgb_24 globalPalette[256];
+    int loopCount;
+    int loopsCompleted;
+
+    // Table based image attributes
+    int tbiImageX;
+    int tbiImageY;
+    int tbiWidth;
+    int tbiHeight;
+    int tbiPackedBits;
+    bool tbiInterlaced;
+
+    int frameDelay;
+    int transparentColorIndex;
+    int prevBackgroundIndex;
+    bool prevBackgroundEmpty;   // Disposal to the background leaves the pixels empty
+    int prevDisposalMethod;
+    int disposalMethod;
+    int lzwCodeSize;
+    bool keyFrame;
+    int rectX;
+    int rectY;
+    int rectWidth;
+    int rectHeight;
+
+    GifClock ownClock;
+    GifClock *clock;
+    bool framePending;          // Frame is drawn but not shown yet
+    bool dropLateFrames;
+    bool dropping;              // decodeFrame() is running, late frames may be dropped
+    bool frameDropped;          // Last frame parsed was drawn but won't be presented
+    int droppedFrames;
+#if GIF_STATS
+    GifStats *stats;
+#endif
+    int droppedX;               // Part of the screen dropped frames drew
+    int droppedY;
+    int droppedWidth;
+    int droppedHeight;
+
+    // Color table of the current frame, globalPalette or localPalette
+    int colorCount;
+    rgb_24 *palette;
+    rgb_24 *localPalette;       // In the arena, NULL unless some frame has a local color table
+
+    // Read-ahead buffer, readData[0] is at file position readBufferFilePos
+    // readData is readBuffer, or all of fileData when the gif is in memory
+    uint8_t readBuffer[GIF_READ_BUFFER_SIZE];
+    const uint8_t *readData;
+    const uint8_t *fileData;
+    size_t fileDataSize;
+    unsigned long readBufferFilePos;
+    int readBufferLen;
+    int readBufferPos;
+
+    int fileCallbacks;
+    int fileCallbacksLastFrame;
+
+    // Frame index and snapshots
+    gif_frame_info *frameIndex;
+    int frameIndexSize;
+    int frameCount;
+    bool frameIndexComplete;
+    FrameSnapshot *frameSnapshots;
+    int frameSnapshotCount;
+    int frameSnapshotInterval;
+    int currentFrame;
+    unsigned long frameStartPosition;
+    bool silentFrame;           // Decode without touching the screen
+    bool redrawCanvas;          // Draw the whole canvas instead of the frame rectangle
+    bool canvasDisposed;        // Previous frame was disposed, draw the whole canvas too
+    // Scaling down, frame rectangle in logical screen coordinates and a row of color sums
+    int scaleMode;
+    int scaleWidth;             // Logical screen size frames are scaled from
+    int scaleHeight;
+    int srcImageX;
+    int srcImageY;
+    int srcWidth;
+    int srcHeight;
+    // All in the arena and only there while scaling
+    uint8_t *scaleChunk;                // GIF_SCALE_CHUNK_SIZE pixels
+    uint32_t (*scaleSum)[3];            // canvasWidth entries each
+    uint16_t *scaleOpaque;
+    uint16_t *scaleTransparent;
+    int16_t *scaleIndex;                // Color of single colored canvas pixels
+
+    int dirtyX;
+    int dirtyY;
+    int dirtyWidth;
+    int dirtyHeight;
+
+    // Buffer image data is decoded into, canvasWidth * canvasHeight
+    uint8_t *imageData;
+
+    // Backup image data buffer for saving portions of image disposal method == 3
+    //   NULL when the file has no such frames
+    uint8_t *imageDataBU;
+
+    // A bit per canvas pixel, set where nothing is drawn. Pixels holding the transparent
+    //   index are empty otherwise, which only holds when all frames share that index.
+    //   NULL unless the file has frames that don't, emptyPixelsBU like imageDataBU
+    uint8_t *emptyPixels;
+    uint8_t *emptyPixelsBU;
+
+    // Row of an interlaced frame each row of its data goes to, canvasHeight entries
+    //   NULL when the file has no such frames or no canvas
+    uint16_t *interlacedRows;
+
+    // Frames drawn over each other as they are, rows go to the screen as soon as they are
+    //   decoded, see streamFrame(). imageData and imageDataBU are NULL then
+    bool streamRows;
+    bool fillCanvas;            // Draw the background before the next frame
+    uint8_t *rowBuffer;         // Also on a canvas with frames wider than it
+
+    void *callbackUser;
+    callback screenClearCallback;
+    callback updateScreenCallback;
+    pixel_callback drawPixelCallback;
+    row_callback drawRowCallback;
+    palette_callback paletteCallback;
+    callback startDrawingCallback;
+    file_seek_callback fileSeekCallback;
+    file_position_callback filePositionCallback;
+    file_read_callback fileReadCallback;
+    file_read_block_callback fileReadBlockCallback;
+
+    // LZW variables
+    int bbits;
+    uint32_t bbuf;              // Bit reservoir, refilled up to 32 bits at a time
+    int cursize;                // The current code size
+    int curmask;
+    int codesize;
+    int clear_code;
+    int end_code;
+    int newcodes;               // First available code
+    int top_slot;               // Highest code for current size
+    int extra_slot;
+    int slot;                   // Last read code
+    int fc, oc;
+    int bs;                     // Bytes left in the current data sub-block
+    bool lzwEndOfData;          // Block terminator of the image data was read
+    uint8_t *sp;
+
+    // Code tables in the arena, lzwTableSize entries each
+    int lzwTableSize;
+    uint8_t *stack;             // Rest of a string that didn't fit the output
+    uint8_t *suffix;
+    uint16_t *prefix;
+    uint16_t *length;           // Length of the string a code stands for
+
+    // Masks for 0 .. 16 bits
+    unsigned int mask[17] = {
+        0x0000, 0x0001, 0x0003, 0x0007,
+        0x000F, 0x001F, 0x003F, 0x007F,
+        0x00FF, 0x01FF, 0x03FF, 0x07FF,
+        0x0FFF, 0x1FFF, 0x3FFF, 0x7FFF,
+        0xFFFF
+    };
+};
+
+#include "GifDecoder_Impl.h"
+
+// Another LZW kernel can be built in instead, test/host/lzwbench.cpp checks and times
+// this one against the one it replaced
+#ifdef LZW_DECODER_IMPL
+#include LZW_DECODER_IMPL
+#else
+#include "LzwDecoder_Impl.h"
+#endif
+
+#endif
@@ -0,0 +1,244 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Where the time of a frame goes. GifDecoder and GifPlayer switch stages as they go,
+// every switch charges the cycles since the last one to the stage that ends. Once a
+// frame is shown its stage times go into a window of the last frames, which gives
+// min, average and p99 per stage. Stages of a frame shown right after it's decoded:
+//
+//   parse      header, extensions and image descriptor
+//   lzw        LZW decode, scaling included
+//   composite  disposal of the last frame and snapshots for seeking
+//   output     row and pixel callbacks, .pnd and cached frames drawn by the player
+//   show       FastLED.show(), or handing the frame to the show task or compositor
+//   wait       waiting for the frame to be due, loop() does everything else meanwhile
+//
+// Built with GIF_STATS 0 none of this exists and every hook is an empty macro.
+
+#ifndef GIF_STATS
+#define GIF_STATS           0     // Time every stage of every frame [0]
+#endif
+
+#define GIF_STAGE_PARSE     0
+#define GIF_STAGE_LZW       1
+#define GIF_STAGE_COMPOSITE 2
+#define GIF_STAGE_OUTPUT    3
+#define GIF_STAGE_SHOW      4
+#define GIF_STAGE_WAIT      5
+#define GIF_STAGES          6
+#define GIF_STAGE_FRAME     6     // All stages of a frame together, for the getters
+
+#if GIF_STATS
+
+#ifndef ESP32
+#include <time.h>
+#endif
+
+#define GIF_STATS_WINDOW    100   // Frames min, average and p99 are taken over [100]
+#define GIF_STATS_LATE_MS   5     // Frames shown more than this after they were due are late [5]
+
+// stats is a GifStats pointer, hooks do nothing while it's NULL
+#define GIF_STATS_ENTER(stats, stage)   do { if (stats) (stats)->enter(stage); } while (0)
+#define GIF_STATS_END_FRAME(stats)      do { if (stats) (stats)->endFrame(); } while (0)
+#define GIF_STATS_BYTES(stats, bytes)   do { if (stats) (stats)->addBytes(bytes); } while (0)
+#define GIF_STATS_DROPPED(stats)        do { if (stats) (stats)->addDropped(); } while (0)
+#define GIF_STATS_LATENESS(stats, ms)   do { if (stats) (stats)->addLateness(ms); } while (0)
+
+class GifStats {
+public:
+    GifStats();
+    void reset();
+    void enter(int stage);
+    void endFrame();
+    void addBytes(unsigned long bytes);
+    void addDropped();
+    void addLateness(unsigned long ms);
+
+    // Times in us over the last getWindowFrames() frames, stage may be GIF_STAGE_FRAME
+    uint32_t getMin(int stage);
+    uint32_t getAverage(int stage);
+    uint32_t getP99(int stage);
+    int getWindowFrames();
+    unsigned long getFrames();
+    unsigned long getBytesRead();
+    unsigned long getDroppedFrames();
+    unsigned long getLateFrames();
+    void print();
+    static const char *getStageName(int stage);
+
+private:
+    static uint32_t cycles();
+    static uint32_t cyclesPerUs();
+
+    int stage;
+    uint32_t stageStart;
+    uint64_t frameCycles[GIF_STAGES];
+
+    // Ring buffer of stage times in us, next is where the next frame goes
+    uint32_t window[GIF_STAGES + 1][GIF_STATS_WINDOW];
+    int windowFrames;
+    int next;
+
+    unsigned long frames;
+    unsigned long bytesRead;
+    unsigned long droppedFrames;
+    unsigned long lateFrames;
+};
+
+GifStats::GifStats() {
+    reset();
+}
+
+void GifStats::reset() {
+    stage = GIF_STAGE_WAIT;
+    stageStart = cycles();
+    memset(frameCycles, 0, sizeof(frameCycles));
+    windowFrames = 0;
+    next = 0;
+    frames = 0;
+    bytesRead = 0;
+    droppedFrames = 0;
+    lateFrames = 0;
+}
+
+// Cycle counter, wraps around but no single stage takes that long
+uint32_t GifStats::cycles() {
+#ifdef ESP32
+    return ESP.getCycleCount();
+#else
+    // A host counts ns
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000000000u + (uint32_t)now.tv_nsec;
+#endif
+}
+
+uint32_t GifStats::cyclesPerUs() {
+#ifdef ESP32
+    return getCpuFrequencyMhz();
+#else
+    return 1000;
+#endif
+}
+
+// Charge the time since the last switch to the stage that ends
+void GifStats::enter(int stage) {
+    uint32_t now = cycles();
+    frameCycles[this->stage] += now - stageStart;
+    stageStart = now;
+    this->stage = stage;
+}
+
+// A frame is shown, its time is up until the next one starts
+void GifStats::endFrame() {
+    enter(GIF_STAGE_WAIT);
+    uint32_t perUs = cyclesPerUs();
+    uint32_t total = 0;
+    for (int i = 0; i < GIF_STAGES; i++) {
+        uint32_t us = frameCycles[i] / perUs;
+        window[i][next] = us;
+        total += us;
+        frameCycles[i] = 0;
+    }
+    window[GIF_STAGE_FRAME][next] = total;
+    next = (next + 1) % GIF_STATS_WINDOW;
+    if (windowFrames < GIF_STATS_WINDOW)
+        windowFrames++;
+    frames++;
+}
+
+void GifStats::addBytes(unsigned long bytes) {
+    bytesRead += bytes;
+}
+
+void GifStats::addDropped() {
+    droppedFrames++;
+}
+
+// How long after it was due a frame was shown
+void GifStats::addLateness(unsigned long ms) {
+    if (ms > GIF_STATS_LATE_MS)
+        lateFrames++;
+}
+
+uint32_t GifStats::getMin(int stage) {
+    uint32_t result = 0;
+    for (int i = 0; i < windowFrames; i++) {
+        if ((i == 0) || (window[stage][i] < result))
+            result = window[stage][i];
+    }
+    return result;
+}
+
+uint32_t GifStats::getAverage(int stage) {
+    if (!windowFrames)
+        return 0;
+    uint64_t sum = 0;
+    for (int i = 0; i < windowFrames; i++) {
+        sum += window[stage][i];
+    }
+    return sum / windowFrames;
+}
+
+// Nearest rank, the slowest frame of 100 doesn't count
+uint32_t GifStats::getP99(int stage) {
+    if (!windowFrames)
+        return 0;
+    uint32_t sorted[GIF_STATS_WINDOW];
+    memcpy(sorted, window[stage], windowFrames * sizeof(uint32_t));
+    // insertion sort, the window is small and this only runs on demand
+    for (int i = 1; i < windowFrames; i++) {
+        uint32_t value = sorted[i];
+        int j = i;
+        for (; (j > 0) && (sorted[j - 1] > value); j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+    int rank = (windowFrames * 99 + 99) / 100;
+    return sorted[rank - 1];
+}
+
+int GifStats::getWindowFrames() {
+    return windowFrames;
+}
+
+unsigned long GifStats::getFrames() {
+    return frames;
+}
+
+unsigned long GifStats::getBytesRead() {
+    return bytesRead;
+}
+
+unsigned long GifStats::getDroppedFrames() {
+    return droppedFrames;
+}
+
+unsigned long GifStats::getLateFrames() {
+    return lateFrames;
+}
+
+void GifStats::print() {
+    Serial.printf("%lu frames, %lu bytes read, %lu dropped, %lu late\n", frames, bytesRead, droppedFrames, lateFrames);
+    Serial.printf("%-10s %8s %8s %8s  us over the last %i frames\n", "stage", "min", "avg", "p99", windowFrames);
+    for (int i = 0; i <= GIF_STAGE_FRAME; i++) {
+        Serial.printf("%-10s %8u %8u %8u\n", getStageName(i), (unsigned)getMin(i), (unsigned)getAverage(i), (unsigned)getP99(i));
+    }
+}
+
+const char *GifStats::getStageName(int stage) {
+    static const char *names[] = { "parse", "lzw", "composite", "output", "show", "wait", "frame" };
+    return ((stage >= 0) && (stage <= GIF_STAGE_FRAME)) ? names[stage] : "?";
+}
+
+#else
+
+#define GIF_STATS_ENTER(stats, stage)
+#define GIF_STATS_END_FRAME(stats)
+#define GIF_STATS_BYTES(stats, bytes)
+#define GIF_STATS_DROPPED(stats)
+#define GIF_STATS_LATENESS(stats, ms)
+
+#endif
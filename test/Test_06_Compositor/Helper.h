@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+
+String getContentType(String filename) {
+//   if (server.hasArg("download")) {
+//     return "application/octet-stream";
+//   } else
+   if (filename.endsWith(".htm")) {
+    return "text/html";
+  } else if (filename.endsWith(".html")) {
+    return "text/html";
+  } else if (filename.endsWith(".css")) {
+    return "text/css";
+  } else if (filename.endsWith(".js")) {
+    return "application/javascript";
+  } else if (filename.endsWith(".png")) {
+    return "image/png";
+  } else if (filename.endsWith(".gif")) {
+    return "image/gif";
+  } else if (filename.endsWith(".jpg")) {
+    return "image/jpeg";
+  } else if (filename.endsWith(".ico")) {
+    return "image/x-icon";
+  } else if (filename.endsWith(".xml")) {
+    return "text/xml";
+  } else if (filename.endsWith(".pdf")) {
+    return "application/x-pdf";
+  } else if (filename.endsWith(".zip")) {
+    return "application/x-zip";
+  } else if (filename.endsWith(".gz")) {
+    return "application/x-gzip";
+  }
+  return "text/plain";
+}
+
+std::string getFilename(std::string filepath){
+  return filepath.substr(filepath.find_last_of("/\\") + 1);
+}
+
+// Frame index sidecar file stored next to a gif
+String getFrameIndexPath(String gifPath){
+  return gifPath + ".idx";
+}
+
+// Pre-decoded .pnd stored next to a gif, see PndEncoder.h
+String getPndPath(String gifPath){
+  return gifPath + ".pnd";
+}
+
+void replaceWhitespace(std::string & str){
+    std::replace(str.begin(), str.end(), ' ', '_');        
+}
+
+// Quotes, backslashes and control characters escaped for a JSON string
+String jsonEscape(String str){
+  String escaped = "";
+  for(unsigned int i = 0; i < str.length(); i++){
+    char c = str[i];
+    if(c == '"' || c == '\\'){
+      escaped += '\\';
+      escaped += c;
+    }else if((uint8_t)c < 0x20){
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      escaped += code;
+    }else{
+      escaped += c;
+    }
+  }
+  return escaped;
+}
@@ -0,0 +1,261 @@
+/*
+ * Animated GIFs Display Code for SmartMatrix and 32x32 RGB LED Panels
+ *
+ * This file contains code to decompress the LZW encoded animated GIF data
+ *
+ * Written by: Craig A. Lindley, Fabrice Bellard and Steven A. Bennett
+ * See my book, "Practical Image Processing in C", John Wiley & Sons, Inc.
+ *
+ * Copyright (c) 2014 Craig A. Lindley
+ * Minor modifications by Louis Beaudoin (pixelmatix)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define LZWDEBUG 0
+
+#if defined (ARDUINO)
+#include <Arduino.h>
+#elif defined (SPARK)
+#include "application.h"
+#endif
+
+#include "GifDecoder.h"
+
+// Initialize LZW decoder
+//   csize initial code size in bits
+//   buf input data
+void GifDecoder::lzw_decode_init (int csize) {
+
+    // Initialize read buffer variables
+    bbuf = 0;
+    bbits = 0;
+    bs = 0;
+    lzwEndOfData = false;
+
+    // Initialize decoder variables
+    codesize = csize;
+    cursize = codesize + 1;
+    curmask = mask[cursize];
+    top_slot = 1 << cursize;
+    clear_code = 1 << codesize;
+    end_code = clear_code + 1;
+    slot = newcodes = clear_code + 2;
+    oc = fc = -1;
+    sp = stack;
+
+    // Root codes stand for a single byte
+    for (int i = 0; i < newcodes; i++) {
+        length[i] = 1;
+    }
+}
+
+//  Get one code of given number of bits from stream
+int GifDecoder::lzw_get_code() {
+
+    if (bbits < cursize) {
+        // Top up the bit reservoir straight from the read-ahead buffer
+        while (bbits <= 24) {
+            if (bs == 0) {
+                // get number of bytes in next block
+                bs = lzwEndOfData ? 0 : readByte();
+                if (bs <= 0) {
+                    // never read past the block terminator
+                    bs = 0;
+                    lzwEndOfData = true;
+                    break;
+                }
+            }
+            if ((readBufferPos == readBufferLen) && !fillReadBuffer()) {
+                bs = 0;
+                lzwEndOfData = true;
+                break;
+            }
+
+            int count = min(min(bs, readBufferLen - readBufferPos), (32 - bbits) >> 3);
+            const uint8_t *src = readData + readBufferPos;
+            readBufferPos += count;
+            bs -= count;
+            while (count--) {
+                bbuf |= (uint32_t)*src++ << bbits;
+                bbits += 8;
+            }
+        }
+
+        if (bbits < cursize) {
+            // Data ran out before the end code
+            return end_code;
+        }
+    }
+
+    int c = bbuf & curmask;
+    bbuf >>= cursize;
+    bbits -= cursize;
+    return c;
+}
+
+// Skip the data sub-blocks left after the frame is decoded
+void GifDecoder::lzw_skip_remaining() {
+
+    if (!lzwEndOfData) {
+        seekStream(streamPosition() + bs);
+        bs = 0;
+        skipDataSubBlocks();
+        lzwEndOfData = true;
+    }
+}
+
+// Decode given number of bytes
+//   buf 8 bit output buffer
+//   len number of pixels to decode
+//   bufend end of the memory buf may be written to
+//   returns the number of bytes written
+int GifDecoder::lzw_decode(uint8_t *buf, int len, uint8_t *bufend) {
+    return lzw_decode_rows(buf, len, 0, NULL, 1, bufend);
+}
+
+// Decode rows of len pixels in one pass over the data
+//   buf first row, the others are stride bytes apart
+//   rowOrder row each len pixels go to in turn, NULL for rows one after the other
+//   rows number of rows to decode
+//   bufend end of the memory the rows may be written to
+//   returns the number of bytes written, less than rows * len when the data ends
+//   or bufend is reached first
+// Strings are written forward straight into the row using the code length table,
+// only a string crossing the end of a row goes through the stack
+int GifDecoder::lzw_decode_rows(uint8_t *buf, int len, int stride, const uint16_t *rowOrder, int rows, uint8_t *bufend) {
+    int c, code, count;
+
+#if LZWDEBUG == 1
+    unsigned char debugMessagePrinted = 0;
+#endif
+
+    if ((end_code < 0) || (rows <= 0)) {
+        return 0;
+    }
+
+    int row = 0;
+    uint8_t *out = rowOrder ? buf + (rowOrder[0] * stride) : buf;
+    uint8_t *outend = out + len;
+
+    for (;;) {
+        // Output what is left of the last string first
+        while (sp > stack) {
+            if(out >= bufend) {
+                // out of bounds, the rest of the string stays on the stack for the next call
+#if LZWDEBUG == 1
+                Serial.println("****** LZW imageData buffer overrun *******");
+#endif
+                return (row * len) + (out - (outend - len));
+            }
+            *out = *(--sp);
+            if (++out == outend) {
+                if (++row == rows) {
+                    return rows * len;
+                }
+                out = buf + ((rowOrder ? rowOrder[row] : row) * stride);
+                outend = out + len;
+            }
+        }
+
+        c = lzw_get_code();
+        if (c == end_code) {
+            break;
+
+        }
+        else if (c == clear_code) {
+            cursize = codesize + 1;
+            curmask = mask[cursize];
+            slot = newcodes;
+            top_slot = 1 << cursize;
+            fc= oc= -1;
+
+        }
+        else    {
+
+            code = c;
+            count = 0;
+            if ((code == slot) && (fc >= 0)) {
+                // String of the previous code plus its own first byte
+                count = 1;
+                code = oc;
+            }
+            else if (code >= slot) {
+                break;
+            }
+            count += length[code];
+
+            if ((count <= outend - out) && (count <= bufend - out)) {
+                // Whole string fits, write it back to front
+                uint8_t *p = out + count;
+                if (code != c) {
+                    *--p = fc;
+                }
+                while (code >= newcodes) {
+                    *--p = suffix[code];
+                    code = prefix[code];
+                }
+                *--p = code;
+                out += count;
+            }
+            else {
+                // Push the string on the stack, it's output at the top of the loop
+                if (code != c) {
+                    *sp++ = fc;
+                }
+                while (code >= newcodes) {
+                    *sp++ = suffix[code];
+                    code = prefix[code];
+                }
+                *sp++ = code;
+            }
+
+            // Tables hold as many codes as the largest frame can add
+            if ((slot < top_slot) && (slot < lzwTableSize) && (oc >= 0)) {
+                suffix[slot] = code;
+                prefix[slot] = oc;
+                length[slot++] = length[oc] + 1;
+            }
+            fc = code;
+            oc = c;
+            if (slot >= top_slot) {
+                if (cursize < LZW_MAXBITS) {
+                    top_slot <<= 1;
+                    curmask = mask[++cursize];
+                } else {
+#if LZWDEBUG == 1
+                    if(!debugMessagePrinted) {
+                        debugMessagePrinted = 1;
+                        Serial.println("****** cursize >= LZW_MAXBITS *******");
+                    }
+#endif
+                }
+
+            }
+            if (out == outend) {
+                if (++row == rows) {
+                    return rows * len;
+                }
+                out = buf + ((rowOrder ? rowOrder[row] : row) * stride);
+                outend = out + len;
+            }
+        }
+    }
+    end_code = -1;
+    return (row * len) + (out - (outend - len));
+}
@@ -0,0 +1,371 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "GifDecoder.h"
+
+// .pnd, a gif decoded ahead of time for the matrix so playing it needs no LZW
+//   header, colorCount palette entries 0xRRGGBBAA, then every frame as
+//   pnd_frame followed by size bytes of spans
+// A span is offset (uint16_t, little endian), count and count palette indices,
+//   or a single index for all count pixels when PND_SPAN_FILL is set. Pixels are
+//   row by row, each frame only holds the ones that changed since the frame before.
+//   The first one is against a canvas of palette entry 0, transparent black.
+
+#define PND_MAGIC         0x31444E50  // "PND1"
+#define PND_SPAN_FILL     0x80        // Span is one index repeated
+#define PND_MAX_SPAN      127         // Pixels per span
+#define PND_MAX_GAP       3           // Unchanged pixels a span runs across rather than ending
+#define PND_MIN_FILL      8           // Equal pixels worth a fill span of their own
+#define PND_MAX_SIZE      32768       // Largest .pnd the encoder writes
+#define PND_MAX_FRAME_SIZE(pixels)  (2 * (pixels))  // Span bytes a frame can have
+
+// Encoder errors, gifs that can't be converted are played as they are
+#define ERROR_PND_TOOMANYCOLORS  -16  // More than 256 colors over all frames
+#define ERROR_PND_TOOLARGE       -17  // Larger than PND_MAX_SIZE
+
+typedef struct pnd_header {
+    uint32_t magic;
+    uint32_t gifSize;           // Size of the gif it was made from, tells a stale one apart
+    uint8_t width;
+    uint8_t height;
+    uint16_t frameCount;
+    uint16_t loopCount;         // NETSCAPE2.0 loop count of the gif, 0 for forever
+    uint16_t colorCount;
+} pnd_header;
+
+typedef struct pnd_frame {
+    uint16_t frameDelay;        // In 1/100 s
+    uint16_t size;              // Span bytes following
+} pnd_frame;
+
+// Decodes a gif for a width x height canvas the way GifPlayer draws it and
+// writes the frames as they are shown, deltas of palette indices
+class PndEncoder {
+public:
+    PndEncoder(int width, int height);
+
+    // Where the gif is read from, the callbacks get user instead of the encoder
+    void setFileCallbacks(file_seek_callback seek, file_position_callback position,
+        file_read_callback read, file_read_block_callback readBlock, void *user);
+    void setScaleMode(int mode);
+    // One loop of the gif into pnd, gifSize goes into the header
+    int encode(std::vector<uint8_t> &pnd, uint32_t gifSize);
+
+private:
+    static void screenClearCallback(void *user);
+    static void drawRowCallback(void *user, int16_t x, int16_t y, const uint8_t *indices, int16_t width, const rgb_24 *palette, int16_t transparentIndex);
+    static unsigned long timeCallback(void *user);
+    static bool fileSeekCallback(void *user, unsigned long position);
+    static unsigned long filePositionCallback(void *user);
+    static int fileReadCallback(void *user);
+    static int fileReadBlockCallback(void *user, void *buffer, int numberOfBytes);
+
+    int addFrame(std::vector<uint8_t> &pnd);
+    void addSpans(std::vector<uint8_t> &pnd, int start, int end);
+    void addLiteralSpans(std::vector<uint8_t> &pnd, int start, int end);
+    void addSpanHeader(std::vector<uint8_t> &pnd, int offset, int count);
+
+    GifDecoder decoder;
+    GifClock clock;
+    unsigned long time_ms;
+    std::vector<uint8_t> arena;
+
+    int width;
+    int height;
+    std::vector<uint32_t> canvas;       // 0xRRGGBBAA, as the frame is shown
+    std::vector<uint8_t> indices;       // canvas as palette indices
+    std::vector<uint8_t> previous;      // indices of the frame before
+    std::vector<uint32_t> palette;
+    int frameCount;
+
+    file_seek_callback fileSeek;
+    file_position_callback filePosition;
+    file_read_callback fileRead;
+    file_read_block_callback fileReadBlock;
+    void *fileUser;
+};
+
+// Walks the spans of a frame, each one sets count pixels from offset on to
+// indices[0], indices[step], ... where step is 0 for a fill span
+class PndSpanReader {
+public:
+    PndSpanReader(const uint8_t *data, int size, int pixels);
+
+    // false after the last span, or at one that doesn't fit, see isValid()
+    bool next(void);
+    bool isValid(void);
+
+    int offset;
+    int count;
+    int step;
+    const uint8_t *indices;
+
+private:
+    const uint8_t *data;
+    const uint8_t *end;
+    int pixels;
+    bool valid;
+};
+
+PndEncoder::PndEncoder(int width, int height) : decoder(width, height), width(width), height(height) {
+    fileSeek = NULL;
+    filePosition = NULL;
+    fileRead = NULL;
+    fileReadBlock = NULL;
+    fileUser = NULL;
+
+    decoder.setCallbackUser(this);
+    decoder.setScreenClearCallback(screenClearCallback);
+    decoder.setDrawRowCallback(drawRowCallback);
+    decoder.setFileSeekCallback(fileSeekCallback);
+    decoder.setFilePositionCallback(filePositionCallback);
+    decoder.setFileReadCallback(fileReadCallback);
+    decoder.setFileReadBlockCallback(fileReadBlockCallback);
+
+    // every frame is encoded, time only moves on to the next one
+    clock.setTimeCallback(timeCallback, this);
+    decoder.setClock(&clock);
+    decoder.setDropLateFrames(false);
+}
+
+void PndEncoder::setFileCallbacks(file_seek_callback seek, file_position_callback position,
+    file_read_callback read, file_read_block_callback readBlock, void *user) {
+    fileSeek = seek;
+    filePosition = position;
+    fileRead = read;
+    fileReadBlock = readBlock;
+    fileUser = user;
+}
+
+void PndEncoder::setScaleMode(int mode) {
+    decoder.setScaleMode(mode);
+}
+
+int PndEncoder::encode(std::vector<uint8_t> &pnd, uint32_t gifSize) {
+    pnd.clear();
+    canvas.assign(width * height, 0);
+    indices.assign(width * height, 0);
+    previous.assign(width * height, 0);
+    palette.assign(1, 0);
+    frameCount = 0;
+    time_ms = 0;
+
+    int result = decoder.startDecoding();
+    if (result == ERROR_OUTOFMEMORY) {
+        arena.resize(decoder.getArenaNeeded());
+        decoder.setArena(arena.data(), arena.size());
+        result = decoder.startDecoding();
+    }
+    if (result < 0) {
+        return result;
+    }
+
+    // frames are drawn by decodeFrame(), the clock jumps to when they are due
+    while (true) {
+        time_ms += decoder.getTimeToNextFrame();
+        decoder.presentFrame();
+
+        result = decoder.decodeFrame();
+        if (result == ERROR_DONE_PARSING) {
+            break;
+        }
+        if (result < 0) {
+            return result;
+        }
+        if (result == ERROR_NONE) {
+            result = addFrame(pnd);
+            if (result < 0) {
+                return result;
+            }
+        }
+    }
+
+    pnd_header header;
+    header.magic = PND_MAGIC;
+    header.gifSize = gifSize;
+    header.width = width;
+    header.height = height;
+    header.frameCount = frameCount;
+    header.loopCount = decoder.getLoopCount();
+    header.colorCount = palette.size();
+
+    std::vector<uint8_t> head((uint8_t *)&header, (uint8_t *)&header + sizeof(header));
+    head.insert(head.end(), (uint8_t *)palette.data(), (uint8_t *)(palette.data() + palette.size()));
+    pnd.insert(pnd.begin(), head.begin(), head.end());
+
+    // the decoder's buffers aren't needed until the next gif
+    std::vector<uint8_t>().swap(arena);
+    decoder.setArena(NULL, 0);
+    return ERROR_NONE;
+}
+
+// Frame the decoder just drew as spans of the pixels that changed
+int PndEncoder::addFrame(std::vector<uint8_t> &pnd) {
+    if (frameCount == 0xffff) {
+        return ERROR_PND_TOOLARGE;
+    }
+
+    int pixels = width * height;
+    int last = 0;
+    for (int i = 0; i < pixels; i++) {
+        uint32_t color = canvas[i];
+        if (palette[last] != color) {
+            last = std::find(palette.begin(), palette.end(), color) - palette.begin();
+            if (last == (int)palette.size()) {
+                if (last == 256) {
+                    return ERROR_PND_TOOMANYCOLORS;
+                }
+                palette.push_back(color);
+            }
+        }
+        indices[i] = last;
+    }
+
+    pnd_frame frame;
+    frame.frameDelay = decoder.getFrameDelay();
+    size_t start = pnd.size();
+    pnd.resize(start + sizeof(frame));
+
+    // a span runs across a few unchanged pixels, a new one would cost its header
+    int i = 0;
+    while (i < pixels) {
+        if (indices[i] == previous[i]) {
+            i++;
+            continue;
+        }
+        int end = i + 1;
+        while (end < pixels) {
+            int next = end;
+            while (next < pixels && next - end <= PND_MAX_GAP && indices[next] == previous[next]) {
+                next++;
+            }
+            if (next == pixels || next - end > PND_MAX_GAP) {
+                break;
+            }
+            end = next + 1;
+        }
+        addSpans(pnd, i, end);
+        i = end;
+    }
+
+    size_t size = pnd.size() - start - sizeof(frame);
+    if (size > (size_t)PND_MAX_FRAME_SIZE(pixels) || pnd.size() > PND_MAX_SIZE) {
+        return ERROR_PND_TOOLARGE;
+    }
+    frame.size = size;
+    memcpy(&pnd[start], &frame, sizeof(frame));
+
+    previous = indices;
+    frameCount++;
+    return ERROR_NONE;
+}
+
+// Pixels start to end, runs of equal ones become fill spans
+void PndEncoder::addSpans(std::vector<uint8_t> &pnd, int start, int end) {
+    int literal = start;
+    int i = start;
+    while (i < end) {
+        int run = 1;
+        while (i + run < end && run < PND_MAX_SPAN && indices[i + run] == indices[i]) {
+            run++;
+        }
+        if (run >= PND_MIN_FILL) {
+            addLiteralSpans(pnd, literal, i);
+            addSpanHeader(pnd, i, run | PND_SPAN_FILL);
+            pnd.push_back(indices[i]);
+            literal = i + run;
+        }
+        i += run;
+    }
+    addLiteralSpans(pnd, literal, end);
+}
+
+void PndEncoder::addLiteralSpans(std::vector<uint8_t> &pnd, int start, int end) {
+    while (start < end) {
+        int count = min(end - start, PND_MAX_SPAN);
+        addSpanHeader(pnd, start, count);
+        pnd.insert(pnd.end(), &indices[start], &indices[start] + count);
+        start += count;
+    }
+}
+
+void PndEncoder::addSpanHeader(std::vector<uint8_t> &pnd, int offset, int count) {
+    pnd.push_back(offset & 0xff);
+    pnd.push_back(offset >> 8);
+    pnd.push_back(count);
+}
+
+void PndEncoder::screenClearCallback(void *user) {
+    PndEncoder *encoder = (PndEncoder *)user;
+    std::fill(encoder->canvas.begin(), encoder->canvas.end(), 0);
+}
+
+// Same clipping as GifPlayer::drawRow(), transparent pixels keep what's under them
+void PndEncoder::drawRowCallback(void *user, int16_t x, int16_t y, const uint8_t *indices, int16_t width, const rgb_24 *palette, int16_t transparentIndex) {
+    PndEncoder *encoder = (PndEncoder *)user;
+    if (y >= encoder->height || x >= encoder->width) {
+        return;
+    }
+    if (x + width > encoder->width) {
+        width = encoder->width - x;
+    }
+    uint32_t *out = &encoder->canvas[y * encoder->width + x];
+    for (int i = 0; i < width; i++) {
+        if (indices[i] != transparentIndex) {
+            const rgb_24 &color = palette[indices[i]];
+            out[i] = ((uint32_t)color.red << 24) | (color.green << 16) | (color.blue << 8) | 255;
+        }
+    }
+}
+
+unsigned long PndEncoder::timeCallback(void *user) {
+    return ((PndEncoder *)user)->time_ms;
+}
+
+bool PndEncoder::fileSeekCallback(void *user, unsigned long position) {
+    PndEncoder *encoder = (PndEncoder *)user;
+    return (*encoder->fileSeek)(encoder->fileUser, position);
+}
+
+unsigned long PndEncoder::filePositionCallback(void *user) {
+    PndEncoder *encoder = (PndEncoder *)user;
+    return (*encoder->filePosition)(encoder->fileUser);
+}
+
+int PndEncoder::fileReadCallback(void *user) {
+    PndEncoder *encoder = (PndEncoder *)user;
+    return (*encoder->fileRead)(encoder->fileUser);
+}
+
+int PndEncoder::fileReadBlockCallback(void *user, void *buffer, int numberOfBytes) {
+    PndEncoder *encoder = (PndEncoder *)user;
+    return (*encoder->fileReadBlock)(encoder->fileUser, buffer, numberOfBytes);
+}
+
+PndSpanReader::PndSpanReader(const uint8_t *data, int size, int pixels)
+    : offset(0), count(0), step(1), indices(NULL), data(data), end(data + size), pixels(pixels), valid(true) {
+}
+
+bool PndSpanReader::next(void) {
+    if (!valid || data == end) {
+        return false;
+    }
+    if (end - data < 4) {
+        valid = false;
+        return false;
+    }
+    offset = data[0] | (data[1] << 8);
+    count = data[2] & ~PND_SPAN_FILL;
+    step = (data[2] & PND_SPAN_FILL) ? 0 : 1;
+    indices = data + 3;
+    data += 3 + (step ? count : 1);
+    if (count == 0 || offset + count > pixels || data > end) {
+        valid = false;
+        return false;
+    }
+    return true;
+}
+
+bool PndSpanReader::isValid(void) {
+    return valid;
+}
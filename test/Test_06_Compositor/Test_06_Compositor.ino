@@ -0,0 +1,76 @@
+// The headers are copies of the ones in Mask_1.1, test/host/compbench.cpp times the same layers on a host
+#include "Compositor.h"
+
+#define BENCHMARK_FRAMES  1000        // Frames rendered and flattened for the benchmark
+
+// gif at the bottom, rainbow added on top at half opacity, dimmed outside of a circle
+Compositor compositor;
+GifLayer gifLayer;
+uint8_t vignette[NUM_LEDS];
+FillLayer vignetteLayer(CRGB(0, 0, 0), vignette);
+
+void drawRainbow(void * user, CRGB * pixels, unsigned long time_ms){
+  int8_t yHueDelta8 = ((int32_t) cos16(time_ms * 27) * (350 / kMatrixWidth)) / 32768;
+  int8_t xHueDelta8 = ((int32_t) cos16(time_ms * 39) * (310 / kMatrixHeight)) / 32768;
+  byte lineStartHue = time_ms / 65536;
+  for (byte y = 0; y < kMatrixHeight; y++) {
+    lineStartHue += yHueDelta8;
+    byte pixelHue = lineStartHue;
+    for (byte x = 0; x < kMatrixWidth; x++) {
+      pixelHue += xHueDelta8;
+      pixels[XY(x, y)] = CHSV(pixelHue, 255, 255);
+    }
+  }
+}
+
+PatternLayer rainbowLayer(drawRainbow);
+
+// Transparent in the middle, black towards the edge
+void fillVignette(){
+  for (int y = 0; y < kMatrixHeight; y++) {
+    for (int x = 0; x < kMatrixWidth; x++) {
+      int dx = 2 * x - (kMatrixWidth - 1);
+      int dy = 2 * y - (kMatrixHeight - 1);
+      int d = sqrt(dx * dx + dy * dy) * 255 / (kMatrixWidth * 1.414f);
+      vignette[XY(x, y)] = qsub8(qadd8(d, d), 64);
+    }
+  }
+}
+
+// Time to render and flatten all layers, FastLED.show() not included
+void benchmark(){
+  unsigned long start = micros();
+  for(int f = 0; f < BENCHMARK_FRAMES; f++){
+    for(int i = 0; i < compositor.layerCount; i++){
+      compositor.layers[i]->render(f * (1000 / COMPOSITOR_FPS));
+    }
+    compositor.flatten();
+  }
+  unsigned long frame_us = (micros() - start) / BENCHMARK_FRAMES;
+  unsigned long budget_us = 1000000 / COMPOSITOR_FPS;
+  Serial.printf("%i layers: %lu us per frame, %lu%% of the %lu us budget at %i fps\n",
+    compositor.layerCount, frame_us, 100 * frame_us / budget_us, budget_us, COMPOSITOR_FPS);
+}
+
+void setup() {
+  Serial.begin(57600);
+  Serial.println("start setup()...");
+
+  fillVignette();
+  rainbowLayer.blendMode = Layer::BLEND_ADD;
+  rainbowLayer.opacity = 128;
+
+  GifPlayer::setupLeds();
+  compositor.addLayer(&gifLayer);
+  compositor.addLayer(&rainbowLayer);
+  compositor.addLayer(&vignetteLayer);
+  compositor.setup();
+
+  benchmark();
+
+  Serial.println("end setup()...");
+}
+
+void loop() {
+  compositor.update();
+}
@@ -0,0 +1,147 @@
+// The LZW kernel GifDecoder had before strings were written forward, kept for lzwbench
+// to time and check the one in Mask_1.1/LzwDecoder_Impl.h against. Every string goes
+// through the stack and is popped a byte at a time, codes are read a byte at a time
+// from a copy of the data sub-block. Rows are decoded one lzw_decode() call each.
+// Built into GifDecoder with -DLZW_DECODER_IMPL='"LzwReference_Impl.h"'.
+
+#include "GifDecoder.h"
+
+// Data sub-block the codes are read from, copied out of the read-ahead buffer
+static uint8_t lzwBlock[255];
+static int lzwBlockPos;
+
+void GifDecoder::lzw_decode_init (int csize) {
+
+    // Initialize read buffer variables
+    bbuf = 0;
+    bbits = 0;
+    bs = 0;
+    lzwBlockPos = 0;
+    lzwEndOfData = false;
+
+    // Initialize decoder variables
+    codesize = csize;
+    cursize = codesize + 1;
+    curmask = mask[cursize];
+    top_slot = 1 << cursize;
+    clear_code = 1 << codesize;
+    end_code = clear_code + 1;
+    slot = newcodes = clear_code + 2;
+    oc = fc = -1;
+    sp = stack;
+}
+
+//  Get one code of given number of bits from stream
+int GifDecoder::lzw_get_code() {
+
+    while (bbits < cursize) {
+        if (lzwBlockPos == bs) {
+            // get number of bytes in next block
+            bs = readByte();
+            lzwBlockPos = 0;
+            if (bs <= 0) {
+                // Data ran out before the end code, never read past the block terminator
+                bs = 0;
+                lzwEndOfData = true;
+                return end_code;
+            }
+            readIntoBuffer(lzwBlock, bs);
+        }
+        bbuf |= lzwBlock[lzwBlockPos] << bbits;
+        bbits += 8;
+        lzwBlockPos++;
+    }
+    int c = bbuf;
+    bbuf >>= cursize;
+    bbits -= cursize;
+    return c & curmask;
+}
+
+// Skip the data sub-blocks left after the frame is decoded
+void GifDecoder::lzw_skip_remaining() {
+
+    if (!lzwEndOfData) {
+        skipDataSubBlocks();
+        lzwEndOfData = true;
+    }
+}
+
+// Decode given number of bytes
+//   buf 8 bit output buffer
+//   len number of pixels to decode
+//   returns the number of bytes decoded
+int GifDecoder::lzw_decode(uint8_t *buf, int len, uint8_t *bufend) {
+    int l, c, code;
+
+    if (end_code < 0) {
+        return 0;
+    }
+    l = len;
+
+    for (;;) {
+        while (sp > stack) {
+            // load buf with data if we're still within bounds
+            if(buf < bufend) {
+                *buf++ = *(--sp);
+            }
+            if ((--l) == 0) {
+                return len;
+            }
+        }
+        c = lzw_get_code();
+        if (c == end_code) {
+            break;
+
+        }
+        else if (c == clear_code) {
+            cursize = codesize + 1;
+            curmask = mask[cursize];
+            slot = newcodes;
+            top_slot = 1 << cursize;
+            fc= oc= -1;
+
+        }
+        else    {
+
+            code = c;
+            if ((code == slot) && (fc >= 0)) {
+                *sp++ = fc;
+                code = oc;
+            }
+            else if (code >= slot) {
+                break;
+            }
+            while (code >= newcodes) {
+                *sp++ = suffix[code];
+                code = prefix[code];
+            }
+            *sp++ = code;
+            // Tables hold as many codes as the largest frame can add
+            if ((slot < top_slot) && (slot < lzwTableSize) && (oc >= 0)) {
+                suffix[slot] = code;
+                prefix[slot++] = oc;
+            }
+            fc = code;
+            oc = c;
+            if ((slot >= top_slot) && (cursize < LZW_MAXBITS)) {
+                top_slot <<= 1;
+                curmask = mask[++cursize];
+            }
+        }
+    }
+    end_code = -1;
+    return len - l;
+}
+
+// A row at a time, the way frames were decoded with this kernel
+int GifDecoder::lzw_decode_rows(uint8_t *buf, int len, int stride, const uint16_t *rowOrder, int rows, uint8_t *bufend) {
+    int decoded = 0;
+    for (int row = 0; row < rows; row++) {
+        int n = lzw_decode(buf + ((rowOrder ? rowOrder[row] : row) * stride), len, bufend);
+        decoded += n;
+        if (n < len) {
+            break;
+        }
+    }
+    return decoded;
+}
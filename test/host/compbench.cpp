@@ -0,0 +1,118 @@
+// Times the compositor with the layers of Test_06_Compositor: a gif at the bottom, a rainbow
+// added on top at half opacity and a vignette fill. The clock moves one compositor frame
+// per update(), so every update() renders, flattens and shows a frame and the gif layer
+// decodes whenever its next frame is due. Update is all of it, render and flatten is the
+// part the sketch's benchmark() times. FastLED.show() is not included, on the mask it
+// takes ~9 ms of the budget.
+//
+//   compbench [-n frames] dir
+//     -n   frames timed [1000]
+//     dir  SPIFFS root, the gifs are played from dir/gifs, .pnd files are written next to them
+
+#include <chrono>
+#include "Arduino.h"
+#include "Compositor.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static Compositor compositor;
+static GifLayer gifLayer;
+static uint8_t vignette[NUM_LEDS];
+static FillLayer vignetteLayer(CRGB(0, 0, 0), vignette);
+
+static void drawRainbow(void * user, CRGB * pixels, unsigned long time_ms){
+  int8_t yHueDelta8 = ((int32_t) cos16(time_ms * 27) * (350 / kMatrixWidth)) / 32768;
+  int8_t xHueDelta8 = ((int32_t) cos16(time_ms * 39) * (310 / kMatrixHeight)) / 32768;
+  byte lineStartHue = time_ms / 65536;
+  for (byte y = 0; y < kMatrixHeight; y++) {
+    lineStartHue += yHueDelta8;
+    byte pixelHue = lineStartHue;
+    for (byte x = 0; x < kMatrixWidth; x++) {
+      pixelHue += xHueDelta8;
+      pixels[XY(x, y)] = CHSV(pixelHue, 255, 255);
+    }
+  }
+}
+
+static PatternLayer rainbowLayer(drawRainbow);
+
+// Transparent in the middle, black towards the edge
+static void fillVignette(){
+  for (int y = 0; y < kMatrixHeight; y++) {
+    for (int x = 0; x < kMatrixWidth; x++) {
+      int dx = 2 * x - (kMatrixWidth - 1);
+      int dy = 2 * y - (kMatrixHeight - 1);
+      int d = sqrt(dx * dx + dy * dy) * 255 / (kMatrixWidth * 1.414f);
+      vignette[XY(x, y)] = qsub8(qadd8(d, d), 64);
+    }
+  }
+}
+
+static double elapsed_us(Clock::time_point start){
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+int main(int argc, char ** argv){
+  int frames = 1000;
+  const char * dir = NULL;
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "-n") && i + 1 < argc){
+      frames = atoi(argv[++i]);
+    }else{
+      dir = argv[i];
+    }
+  }
+  if(!dir || frames <= 0){
+    fprintf(stderr, "usage: compbench [-n frames] dir\n");
+    return 1;
+  }
+  spiffsRoot = dir;
+
+  fillVignette();
+  rainbowLayer.blendMode = Layer::BLEND_ADD;
+  rainbowLayer.opacity = 128;
+
+  GifPlayer::setupLeds();
+  compositor.addLayer(&gifLayer);
+  compositor.addLayer(&rainbowLayer);
+  compositor.addLayer(&vignetteLayer);
+  compositor.setup();
+  if(!gifLayer.player.getCurrentFile()){
+    fprintf(stderr, "No gif in %s/gifs\n", dir);
+    return 1;
+  }
+
+  double update_us = 0;
+  double max_us = 0;
+  unsigned long shows = 0;
+  for(int f = 0; f < frames; f++){
+    hostMillis += 1000 / COMPOSITOR_FPS;
+    unsigned long skipped = compositor.getSkippedShows();
+    Clock::time_point start = Clock::now();
+    compositor.update();
+    double us = elapsed_us(start);
+    update_us += us;
+    max_us = max(max_us, us);
+    if(compositor.getSkippedShows() == skipped){
+      shows++;
+    }
+  }
+
+  Clock::time_point start = Clock::now();
+  for(int f = 0; f < frames; f++){
+    for(int i = 0; i < compositor.layerCount; i++){
+      compositor.layers[i]->render(f * (1000 / COMPOSITOR_FPS));
+    }
+    compositor.flatten();
+  }
+  double render_us = elapsed_us(start);
+
+  double budget_us = 1000000.0 / COMPOSITOR_FPS;
+  printf("%i layers, %i frames, %lu shown, budget %.0f us per frame at %i fps\n",
+    compositor.layerCount, frames, shows, budget_us, COMPOSITOR_FPS);
+  printf("update           %8.1f us per frame, %5.2f%% of the budget, slowest %.1f us\n",
+    update_us / frames, 100 * update_us / frames / budget_us, max_us);
+  printf("render, flatten  %8.1f us per frame, %5.2f%% of the budget\n",
+    render_us / frames, 100 * render_us / frames / budget_us);
+  return 0;
+}
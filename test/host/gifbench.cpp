@@ -0,0 +1,596 @@
+// Decodes gifs with GifDecoder on a Linux host. For each gif and canvas it reports
+// decode speed, file callbacks, seeks, decoder memory, the NETSCAPE loop count, file
+// callbacks of a loop after the first, frames dropped and the CRC of every frame of
+// the first two loops as it's shown, which can be checked against or written to a
+// golden file. Time is a fake clock, only moved by the program.
+// On the mask canvas each gif is also converted to .pnd, which has to show the same
+// frames as the first loop, and the time playing a loop of it takes is reported.
+// With a gif pack every gif is decoded from it as well, straight from the mapped
+// file without any file callbacks, and has to show the same frames.
+// GifDecoder::probe() has to find the frames, loop count and arena the decode did,
+// and the time a loop took on a canvas that shows frames when they are due.
+//
+//   gifbench [-n loops] [-g golden.txt] [-u golden.txt] [-p pack.bin] [-v] file.gif...
+//     -n  loops timed per gif and canvas [20]
+//     -g  compare the frame CRCs with a golden file, exit status 1 on any difference
+//     -u  write the frame CRCs to a golden file
+//     -p  gif pack made by gifpack from the same files
+//     -v  print the decoder's Serial output to stderr
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "GifDecoder.h"
+#include "PndEncoder.h"
+#include "GifPack.h"
+
+#define MAX_DECODE_CALLS  100000      // Gives up on a gif that never finishes a loop
+
+// Canvas the gif is decoded for, "mask" is what the player on the device uses.
+// Showing a frame takes showCost ms of the fake clock, "slow" falls behind and drops
+// frames. Its golden lines hold the time every frame was shown at as well.
+// Gifs are converted to .pnd on the canvases with pnd set.
+typedef struct {
+  const char * name;
+  int width;
+  int height;
+  int scaleMode;
+  float speed;
+  unsigned long minFrameTime_ms;
+  unsigned long showCost_ms;
+  bool pnd;
+} CanvasConfig;
+
+static const CanvasConfig canvasConfigs[] = {
+  { "mask", 17, 17, GIF_SCALE_BOX, 1.0f, 0, 0, true },
+  { "full", 256, 256, GIF_SCALE_NONE, 1.0f, 0, 0, false },
+  { "slow", 17, 17, GIF_SCALE_BOX, 2.0f, 20, 25, false },
+};
+
+// Everything the callbacks need, passed as their user pointer
+typedef struct {
+  FILE * file;
+  int width;
+  int height;
+  std::vector<uint8_t> rgb;
+  std::vector<uint32_t> crcs;
+  std::vector<unsigned long> times;
+  bool keepCrcs;
+  unsigned long time_ms;
+  unsigned long showCost_ms;
+  long reads;
+  long blockReads;
+  long seeks;
+  long positions;
+} Canvas;
+
+typedef struct {
+  int frames;
+  int error;
+  int loopCount;
+  long loopFileCallbacks;
+  size_t memory;
+  long reads;
+  long blockReads;
+  long seeks;
+  double loop_ms;
+  int dropped;
+  std::vector<uint32_t> crcs;
+  std::vector<unsigned long> times;
+  int pndError;
+  size_t pndSize;
+  bool pndMatches;
+  double pndLoop_ms;
+  gif_info info;
+  double probe_ms;
+} Result;
+
+static uint32_t crcTable[256];
+
+static void initCrc32(){
+  for(uint32_t i = 0; i < 256; i++){
+    uint32_t c = i;
+    for(int k = 0; k < 8; k++){
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+    }
+    crcTable[i] = c;
+  }
+}
+
+static uint32_t crc32(const uint8_t * data, size_t size){
+  uint32_t c = 0xFFFFFFFF;
+  for(size_t i = 0; i < size; i++){
+    c = crcTable[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+  }
+  return c ^ 0xFFFFFFFF;
+}
+
+static void screenClearCallback(void * user){
+  Canvas * canvas = (Canvas *)user;
+  memset(canvas->rgb.data(), 0, canvas->rgb.size());
+}
+
+static void updateScreenCallback(void * user){
+  Canvas * canvas = (Canvas *)user;
+  if(canvas->keepCrcs){
+    canvas->crcs.push_back(crc32(canvas->rgb.data(), canvas->rgb.size()));
+    canvas->times.push_back(canvas->time_ms);
+  }
+  canvas->time_ms += canvas->showCost_ms;
+}
+
+static unsigned long timeCallback(void * user){
+  return ((Canvas *)user)->time_ms;
+}
+
+static void drawRowCallback(void * user, int16_t x, int16_t y, const uint8_t * indices, int16_t width, const rgb_24 * palette, int16_t transparentIndex){
+  Canvas * canvas = (Canvas *)user;
+  if(y >= canvas->height || x >= canvas->width){
+    return;
+  }
+  if(x + width > canvas->width){
+    width = canvas->width - x;
+  }
+  uint8_t * out = &canvas->rgb[3 * (y * canvas->width + x)];
+  for(int i = 0; i < width; i++, out += 3){
+    if(indices[i] != transparentIndex){
+      out[0] = palette[indices[i]].red;
+      out[1] = palette[indices[i]].green;
+      out[2] = palette[indices[i]].blue;
+    }
+  }
+}
+
+static bool fileSeekCallback(void * user, unsigned long position){
+  Canvas * canvas = (Canvas *)user;
+  canvas->seeks++;
+  return fseek(canvas->file, position, SEEK_SET) == 0;
+}
+
+static unsigned long filePositionCallback(void * user){
+  Canvas * canvas = (Canvas *)user;
+  canvas->positions++;
+  return ftell(canvas->file);
+}
+
+static int fileReadCallback(void * user){
+  Canvas * canvas = (Canvas *)user;
+  canvas->reads++;
+  return fgetc(canvas->file);
+}
+
+static int fileReadBlockCallback(void * user, void * buffer, int numberOfBytes){
+  Canvas * canvas = (Canvas *)user;
+  canvas->blockReads++;
+  return fread(buffer, 1, numberOfBytes, canvas->file);
+}
+
+static long fileCallbacks(const Canvas & canvas){
+  return canvas.reads + canvas.blockReads + canvas.seeks + canvas.positions;
+}
+
+// Decode one loop of the gif, frames are shown as soon as they are drawn
+static int decodeLoop(GifDecoder & decoder, Canvas & canvas, int & frames){
+  frames = 0;
+  for(int calls = 0; calls < MAX_DECODE_CALLS; calls++){
+    // the fake clock jumps to when the frame is due
+    canvas.time_ms += decoder.getTimeToNextFrame();
+    decoder.presentFrame();
+
+    int result = decoder.decodeFrame();
+    if(result == ERROR_DONE_PARSING){
+      decoder.presentFrame();
+      return ERROR_NONE;
+    }
+    if(result < 0){
+      return result;
+    }
+    if(result == ERROR_NONE){
+      frames++;
+    }
+  }
+  return ERROR_BADGIFFORMAT;
+}
+
+// data is the gif in memory, NULL to read the file through the callbacks
+static void decodeGif(const char * path, const CanvasConfig & config, int loops, Result & result, const uint8_t * data = NULL, size_t size = 0){
+  Canvas canvas;
+  canvas.file = fopen(path, "rb");
+  canvas.width = config.width;
+  canvas.height = config.height;
+  canvas.rgb.assign(3 * config.width * config.height, 0);
+  canvas.keepCrcs = true;
+  canvas.time_ms = 0;
+  canvas.showCost_ms = config.showCost_ms;
+  canvas.reads = canvas.blockReads = canvas.seeks = canvas.positions = 0;
+
+  result.frames = 0;
+  result.memory = 0;
+  result.loop_ms = 0;
+  result.dropped = 0;
+  result.crcs.clear();
+  result.times.clear();
+  if(!canvas.file){
+    result.error = ERROR_FILEOPEN;
+    return;
+  }
+
+  GifDecoder decoder(config.width, config.height);
+  decoder.setCallbackUser(&canvas);
+  decoder.setScreenClearCallback(screenClearCallback);
+  decoder.setUpdateScreenCallback(updateScreenCallback);
+  decoder.setDrawRowCallback(drawRowCallback);
+  decoder.setFileSeekCallback(fileSeekCallback);
+  decoder.setFilePositionCallback(filePositionCallback);
+  decoder.setFileReadCallback(fileReadCallback);
+  decoder.setFileReadBlockCallback(fileReadBlockCallback);
+  decoder.setFileData(data, size);
+  decoder.setScaleMode(config.scaleMode);
+
+  GifClock clock;
+  clock.setTimeCallback(timeCallback, &canvas);
+  clock.setSpeed(config.speed);
+  clock.setMinFrameTime(config.minFrameTime_ms);
+  decoder.setClock(&clock);
+
+  std::vector<uint8_t> arena;
+  result.error = decoder.startDecoding();
+  if(result.error == ERROR_OUTOFMEMORY){
+    arena.resize(decoder.getArenaNeeded());
+    decoder.setArena(arena.data(), arena.size());
+    result.error = decoder.startDecoding();
+  }
+  result.memory = sizeof(GifDecoder) + arena.size();
+
+  // the first loop gives the file callbacks, the first two the CRCs, the timed ones run after them
+  if(result.error >= 0){
+    result.error = decodeLoop(decoder, canvas, result.frames);
+  }
+  result.crcs = canvas.crcs;
+  result.reads = canvas.reads;
+  result.blockReads = canvas.blockReads;
+  result.seeks = canvas.seeks;
+  result.loopCount = decoder.getLoopCount();
+
+  // the second loop starts over at the first frame, its CRCs are checked too
+  result.loopFileCallbacks = 0;
+  if(result.error >= 0){
+    long callbacks = fileCallbacks(canvas);
+    int frames;
+    result.error = decodeLoop(decoder, canvas, frames);
+    result.loopFileCallbacks = fileCallbacks(canvas) - callbacks;
+    result.crcs = canvas.crcs;
+  }
+  result.times = canvas.times;
+  result.dropped = decoder.getDroppedFrames();
+
+  if(result.error >= 0 && loops > 0){
+    canvas.keepCrcs = false;
+    int frames;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < loops; i++){
+      decodeLoop(decoder, canvas, frames);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    result.loop_ms = elapsed.count() / loops;
+  }
+  fclose(canvas.file);
+}
+
+// Probe the gif on a decoder of its own, loops times when timed
+static int probeGif(const char * path, const CanvasConfig & config, int loops, Result & result){
+  Canvas canvas;
+  canvas.file = fopen(path, "rb");
+  canvas.reads = canvas.blockReads = canvas.seeks = canvas.positions = 0;
+  result.probe_ms = 0;
+  if(!canvas.file){
+    return ERROR_FILEOPEN;
+  }
+
+  GifDecoder decoder(config.width, config.height);
+  decoder.setCallbackUser(&canvas);
+  decoder.setFileSeekCallback(fileSeekCallback);
+  decoder.setFilePositionCallback(filePositionCallback);
+  decoder.setFileReadCallback(fileReadCallback);
+  decoder.setFileReadBlockCallback(fileReadBlockCallback);
+  decoder.setScaleMode(config.scaleMode);
+  int error = decoder.probe(result.info);
+
+  if(error >= 0 && loops > 0){
+    gif_info info;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < loops; i++){
+      decoder.probe(info);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    result.probe_ms = elapsed.count() / loops;
+  }
+  fclose(canvas.file);
+  return error;
+}
+
+// What probing found has to be what decoding the gif did
+static bool probeMatches(const CanvasConfig & config, const Result & result){
+  const gif_info & info = result.info;
+  if(info.arenaNeeded != result.memory - sizeof(GifDecoder) || info.loopCount != result.loopCount){
+    return false;
+  }
+  // late frames aren't counted, and slower frames don't take their delay
+  if(result.dropped > 0 || config.speed != 1.0f || config.minFrameTime_ms || config.showCost_ms){
+    return true;
+  }
+  return info.frameCount == result.frames && result.times.size() > (size_t)result.frames
+    && result.times[result.frames] - result.times[0] == info.duration_ms;
+}
+
+// Play one loop of a .pnd into canvas the way GifPlayer does, frames are only
+// drawn where they changed. Returns the frames played, -1 when pnd is broken.
+static int playPndLoop(const std::vector<uint8_t> & pnd, Canvas & canvas){
+  pnd_header header;
+  memcpy(&header, pnd.data(), sizeof(header));
+  const uint32_t * palette = (const uint32_t *)&pnd[sizeof(header)];
+  size_t position = sizeof(header) + header.colorCount * sizeof(uint32_t);
+  int pixels = header.width * header.height;
+
+  // every loop starts on a blank canvas
+  memset(canvas.rgb.data(), 0, canvas.rgb.size());
+  for(int frame = 0; frame < header.frameCount; frame++){
+    pnd_frame info;
+    memcpy(&info, &pnd[position], sizeof(info));
+    position += sizeof(info);
+    PndSpanReader spans(&pnd[position], info.size, pixels);
+    position += info.size;
+    while(spans.next()){
+      const uint8_t * index = spans.indices;
+      uint8_t * out = &canvas.rgb[3 * spans.offset];
+      for(int i = 0; i < spans.count; i++, index += spans.step, out += 3){
+        uint32_t color = palette[*index];
+        out[0] = color >> 24;
+        out[1] = color >> 16;
+        out[2] = color >> 8;
+      }
+    }
+    if(!spans.isValid()){
+      return -1;
+    }
+    if(canvas.keepCrcs){
+      canvas.crcs.push_back(crc32(canvas.rgb.data(), canvas.rgb.size()));
+    }
+  }
+  return header.frameCount;
+}
+
+// Convert the gif to .pnd, its frames have to match the first loop of the gif
+static void encodePnd(const char * path, const CanvasConfig & config, int loops, Result & result){
+  Canvas canvas;
+  canvas.file = fopen(path, "rb");
+  canvas.width = config.width;
+  canvas.height = config.height;
+  canvas.rgb.assign(3 * config.width * config.height, 0);
+  canvas.keepCrcs = true;
+  canvas.reads = canvas.blockReads = canvas.seeks = canvas.positions = 0;
+
+  result.pndSize = 0;
+  result.pndMatches = false;
+  result.pndLoop_ms = 0;
+  if(!canvas.file){
+    result.pndError = ERROR_FILEOPEN;
+    return;
+  }
+
+  PndEncoder encoder(config.width, config.height);
+  encoder.setFileCallbacks(fileSeekCallback, filePositionCallback, fileReadCallback, fileReadBlockCallback, &canvas);
+  encoder.setScaleMode(config.scaleMode);
+  std::vector<uint8_t> pnd;
+  result.pndError = encoder.encode(pnd, 0);
+  fclose(canvas.file);
+  if(result.pndError < 0){
+    return;
+  }
+  result.pndSize = pnd.size();
+
+  int frames = playPndLoop(pnd, canvas);
+  result.pndMatches = frames == result.frames
+    && std::equal(canvas.crcs.begin(), canvas.crcs.end(), result.crcs.begin());
+
+  if(loops > 0){
+    canvas.keepCrcs = false;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int i = 0; i < loops; i++){
+      playPndLoop(pnd, canvas);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    result.pndLoop_ms = elapsed.count() / loops;
+  }
+}
+
+// Golden file lines: path canvas error frame CRCs..., each CRC is time:CRC when showing takes time
+static std::string goldenLine(const char * path, const CanvasConfig & config, const Result & result){
+  std::string line = std::string(path) + " " + config.name + " " + std::to_string(result.error);
+  char crc[32];
+  for(size_t i = 0; i < result.crcs.size(); i++){
+    if(config.showCost_ms){
+      snprintf(crc, sizeof(crc), " %lu:%08x", result.times[i], result.crcs[i]);
+    }else{
+      snprintf(crc, sizeof(crc), " %08x", result.crcs[i]);
+    }
+    line += crc;
+  }
+  return line;
+}
+
+static bool readGolden(const char * path, std::map<std::string, std::string> & golden){
+  FILE * file = fopen(path, "r");
+  if(!file){
+    return false;
+  }
+  char buffer[65536];
+  while(fgets(buffer, sizeof(buffer), file)){
+    std::string line(buffer);
+    while(!line.empty() && (line.back() == '\n' || line.back() == '\r')){
+      line.pop_back();
+    }
+    // key is path and canvas
+    size_t space = line.find(' ');
+    space = (space == std::string::npos) ? space : line.find(' ', space + 1);
+    if(space != std::string::npos){
+      golden[line.substr(0, space)] = line;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char ** argv){
+  int loops = 20;
+  const char * checkPath = NULL;
+  const char * updatePath = NULL;
+  const char * packPath = NULL;
+  std::vector<const char *> files;
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "-n") && i + 1 < argc){
+      loops = atoi(argv[++i]);
+    }else if(!strcmp(argv[i], "-g") && i + 1 < argc){
+      checkPath = argv[++i];
+    }else if(!strcmp(argv[i], "-u") && i + 1 < argc){
+      updatePath = argv[++i];
+    }else if(!strcmp(argv[i], "-p") && i + 1 < argc){
+      packPath = argv[++i];
+    }else if(!strcmp(argv[i], "-v")){
+      Serial.out = stderr;
+    }else{
+      files.push_back(argv[i]);
+    }
+  }
+  if(files.empty()){
+    fprintf(stderr, "usage: gifbench [-n loops] [-g golden.txt] [-u golden.txt] [-p pack.bin] [-v] file.gif...\n");
+    return 2;
+  }
+
+  std::map<std::string, std::string> golden;
+  if(checkPath && !readGolden(checkPath, golden)){
+    fprintf(stderr, "Can not read golden file: %s\n", checkPath);
+    return 2;
+  }
+  FILE * update = updatePath ? fopen(updatePath, "w") : NULL;
+  if(updatePath && !update){
+    fprintf(stderr, "Can not write golden file: %s\n", updatePath);
+    return 2;
+  }
+  GifPack pack;
+  if(packPath && !pack.begin(packPath)){
+    fprintf(stderr, "Can not map gif pack: %s\n", packPath);
+    return 2;
+  }
+
+  initCrc32();
+  int failures = 0;
+  printf("%-40s %-6s %6s %9s %9s %8s %6s %6s %6s %8s %5s %7s %5s %6s %8s %8s %8s %s\n",
+    "file", "canvas", "frames", "ms/loop", "frames/s", "MB/s", "reads", "blocks", "seeks", "memory", "loops", "cb/loop", "drops", "pnd", "ms/pnd", "ms/map", "ms/probe", checkPath ? "golden" : "");
+  for(size_t f = 0; f < files.size(); f++){
+    FILE * file = fopen(files[f], "rb");
+    long fileSize = 0;
+    if(file){
+      fseek(file, 0, SEEK_END);
+      fileSize = ftell(file);
+      fclose(file);
+    }
+    std::string path(files[f]);
+    size_t packedSize = 0;
+    const uint8_t * packed = packPath ? pack.find(path.substr(path.find_last_of("/\\") + 1).c_str(), packedSize) : NULL;
+    if(packPath && !packed){
+      fprintf(stderr, "Not in the gif pack: %s\n", files[f]);
+      failures++;
+    }
+
+    for(size_t c = 0; c < sizeof(canvasConfigs) / sizeof(canvasConfigs[0]); c++){
+      const CanvasConfig & config = canvasConfigs[c];
+      Result result;
+      decodeGif(files[f], config, loops, result);
+
+      std::string line = goldenLine(files[f], config, result);
+      const char * status = "";
+      if(checkPath){
+        std::map<std::string, std::string>::iterator itr = golden.find(std::string(files[f]) + " " + config.name);
+        if(itr == golden.end()){
+          status = "MISSING";
+          failures++;
+        }else if(itr->second != line){
+          status = "FAIL";
+          failures++;
+        }else{
+          status = "ok";
+        }
+      }
+
+      // gifs the encoder turns down are played as gifs, anything else has to match
+      char pnd[64] = "     -        -";
+      if(config.pnd && result.error >= 0){
+        encodePnd(files[f], config, loops, result);
+        if(result.pndError < 0){
+          snprintf(pnd, sizeof(pnd), "%6i %8s", result.pndError, "-");
+        }else if(!result.pndMatches){
+          snprintf(pnd, sizeof(pnd), "%6zu %8s", result.pndSize, "-");
+          status = "PND FAIL";
+          failures++;
+        }else if(loops > 0){
+          snprintf(pnd, sizeof(pnd), "%6zu %8.3f", result.pndSize, result.pndLoop_ms);
+        }else{
+          snprintf(pnd, sizeof(pnd), "%6zu %8s", result.pndSize, "-");
+        }
+      }
+
+      // decoding from the pack needs no file callbacks and shows the same frames
+      char map[16] = "       -";
+      if(packed){
+        Result mapped;
+        decodeGif(files[f], config, loops, mapped, packed, packedSize);
+        if(mapped.error != result.error || mapped.crcs != result.crcs || mapped.times != result.times
+          || mapped.reads + mapped.blockReads + mapped.seeks > 0){
+          status = "MAP FAIL";
+          failures++;
+        }else if(loops > 0 && result.error >= 0){
+          snprintf(map, sizeof(map), "%8.3f", mapped.loop_ms);
+        }
+      }
+      if(update){
+        fprintf(update, "%s\n", line.c_str());
+      }
+
+      // probing a gif that decodes gives what decoding found without decoding it
+      char probe[16] = "       -";
+      if(result.error >= 0){
+        if(probeGif(files[f], config, loops, result) < 0 || !probeMatches(config, result)){
+          status = "PROBE FAIL";
+          failures++;
+        }else if(loops > 0){
+          snprintf(probe, sizeof(probe), "%8.4f", result.probe_ms);
+        }
+      }
+
+      if(result.error < 0){
+        printf("%-40s %-6s error %i %s\n", files[f], config.name, result.error, status);
+        continue;
+      }
+      char timing[64] = "        -         -        -";
+      if(loops > 0){
+        double seconds = result.loop_ms / 1000;
+        snprintf(timing, sizeof(timing), "%9.3f %9.0f %8.2f", result.loop_ms, result.frames / seconds, fileSize / seconds / 1e6);
+      }
+      printf("%-40s %-6s %6i %s %6li %6li %6li %8zu %5i %7li %5i %s %s %s %s\n",
+        files[f], config.name, result.frames, timing,
+        result.reads, result.blockReads, result.seeks, result.memory,
+        result.loopCount, result.loopFileCallbacks, result.dropped, pnd, map, probe, status);
+    }
+  }
+
+  if(update){
+    fclose(update);
+  }
+  if(checkPath){
+    printf("%s: %i difference%s\n", checkPath, failures, failures == 1 ? "" : "s");
+  }
+  return failures ? 1 : 0;
+}
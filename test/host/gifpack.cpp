@@ -0,0 +1,111 @@
+// Packs gifs into an image for the gif pack partition, see Mask_1.1/GifPack.h.
+// Files are stored under their name without the directory, a name that's
+// already packed is skipped when the data is the same and an error otherwise.
+//
+//   gifpack [-s size] pack.bin file.gif...
+//     -s  partition size in bytes, fails when the image doesn't fit
+
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "GifPack.h"
+
+static bool readFile(const char * path, std::vector<uint8_t> & data){
+  FILE * file = fopen(path, "rb");
+  if(!file){
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  data.resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  bool read = fread(data.data(), 1, data.size(), file) == data.size();
+  fclose(file);
+  return read;
+}
+
+int main(int argc, char ** argv){
+  long partitionSize = 0;
+  const char * packPath = NULL;
+  std::vector<const char *> files;
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "-s") && i + 1 < argc){
+      partitionSize = strtol(argv[++i], NULL, 0);
+    }else if(!packPath){
+      packPath = argv[i];
+    }else{
+      files.push_back(argv[i]);
+    }
+  }
+  if(!packPath){
+    fprintf(stderr, "usage: gifpack [-s size] pack.bin file.gif...\n");
+    return 2;
+  }
+
+  std::vector<gif_pack_entry> entries;
+  std::vector<std::vector<uint8_t> > contents;
+  for(size_t f = 0; f < files.size(); f++){
+    std::string path(files[f]);
+    std::string name = path.substr(path.find_last_of("/\\") + 1);
+    if(name.size() >= GIF_PACK_NAME_SIZE){
+      fprintf(stderr, "Name too long to pack: %s\n", files[f]);
+      return 1;
+    }
+    std::vector<uint8_t> data;
+    if(!readFile(files[f], data)){
+      fprintf(stderr, "Can not read %s\n", files[f]);
+      return 1;
+    }
+
+    bool packed = false;
+    for(size_t i = 0; i < entries.size() && !packed; i++){
+      if(name == entries[i].name){
+        if(data != contents[i]){
+          fprintf(stderr, "Another %s is packed already: %s\n", name.c_str(), files[f]);
+          return 1;
+        }
+        packed = true;
+      }
+    }
+    if(packed){
+      continue;
+    }
+
+    gif_pack_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    strcpy(entry.name, name.c_str());
+    entry.size = data.size();
+    entries.push_back(entry);
+    contents.push_back(data);
+  }
+
+  // files follow the directory, each one 4 byte aligned
+  gif_pack_header header = { GIF_PACK_MAGIC, (uint32_t)entries.size() };
+  size_t offset = sizeof(header) + entries.size() * sizeof(gif_pack_entry);
+  for(size_t i = 0; i < entries.size(); i++){
+    offset = (offset + 3) & ~3;
+    entries[i].offset = offset;
+    offset += entries[i].size;
+  }
+  if(partitionSize && (long)offset > partitionSize){
+    fprintf(stderr, "Pack of %zu bytes doesn't fit the partition of %ld\n", offset, partitionSize);
+    return 1;
+  }
+
+  std::vector<uint8_t> image(offset, 0);
+  memcpy(&image[0], &header, sizeof(header));
+  if(!entries.empty()){
+    memcpy(&image[sizeof(header)], entries.data(), entries.size() * sizeof(gif_pack_entry));
+  }
+  for(size_t i = 0; i < entries.size(); i++){
+    memcpy(&image[entries[i].offset], contents[i].data(), entries[i].size);
+  }
+
+  FILE * file = fopen(packPath, "wb");
+  if(!file || fwrite(image.data(), 1, image.size(), file) != image.size()){
+    fprintf(stderr, "Can not write %s\n", packPath);
+    return 1;
+  }
+  fclose(file);
+  printf("%s: %zu files, %zu bytes\n", packPath, entries.size(), image.size());
+  return 0;
+}
@@ -0,0 +1,160 @@
+# Writes the synthetic gifs of the host test corpus, each one covers a decoder
+# feature: disposal methods, transparency, local color tables, interlacing,
+# odd sub-block sizes, logical screens larger than the mask, frames larger than
+# the logical screen and frames with different transparent indices.
+# With --lzw it writes the larger gifs lzwbench times LZW kernels on instead, they
+# aren't part of the corpus and are made by make lzw.
+#   python3 gifgen.py [--lzw] <output directory>
+import struct, random, sys
+
+def lzw_encode(data, min_code_size, clear_every=None):
+    clear = 1 << min_code_size; end = clear + 1
+    out = []; bits = 0; nbits = 0
+    def emit(code, size):
+        nonlocal bits, nbits
+        bits |= code << nbits; nbits += size
+        while nbits >= 8:
+            out.append(bits & 0xff); bits >>= 8; nbits -= 8
+    size = min_code_size + 1
+    table = {}; nxt = end + 1
+    emit(clear, size)
+    w = b''
+    for i, ch in enumerate(data):
+        c = bytes([ch])
+        wc = w + c
+        if wc in table or len(wc) == 1:
+            w = wc; continue
+        emit(table[w] if len(w) > 1 else w[0], size)
+        if nxt < 4096:
+            table[wc] = nxt; nxt += 1
+            if nxt - 1 == (1 << size) and size < 12:
+                size += 1
+        else:
+            emit(clear, size); table = {}; nxt = end + 1; size = min_code_size + 1
+        w = c
+    if w:
+        emit(table[w] if len(w) > 1 else w[0], size)
+    emit(end, size)
+    if nbits: out.append(bits & 0xff)
+    return bytes(out)
+
+def subblocks(data, bs=255):
+    o = b''
+    for i in range(0, len(data), bs):
+        ch = data[i:i+bs]; o += bytes([len(ch)]) + ch
+    return o + b'\x00'
+
+def interlace_rows(h):
+    return list(range(0,h,8)) + list(range(4,h,8)) + list(range(2,h,4)) + list(range(1,h,2))
+
+def make_gif(path, W, H, frames, gct_bits=8, loop=0, comment=None, bg=0, seed=0, bs=255, plaintext=False):
+    rnd = random.Random(seed)
+    o = b'GIF89a' + struct.pack('<HHBBB', W, H, 0x80 | 0x70 | (gct_bits-1), bg, 0)
+    ncol = 1 << gct_bits
+    o += bytes(rnd.randrange(256) for _ in range(3*ncol))
+    if loop is not None:
+        o += b'\x21\xff\x0bNETSCAPE2.0\x03\x01' + struct.pack('<H', loop) + b'\x00'
+    if comment:
+        o += b'\x21\xfe' + subblocks(comment.encode())
+    if plaintext:
+        o += b'\x21\x01\x0c' + bytes(12) + subblocks(b'hello world')
+    for f in frames:
+        x, y, w, h = f.get('rect', (0, 0, W, H))
+        disp = f.get('disposal', 0); tr = f.get('transparent'); delay = f.get('delay', 10)
+        pk = (disp << 2) | (1 if tr is not None else 0)
+        o += b'\x21\xf9\x04' + struct.pack('<BHB', pk, delay, tr or 0) + b'\x00'
+        lct = f.get('lct_bits'); il = f.get('interlace', False)
+        pk = (0x80 | (lct-1) if lct else 0) | (0x40 if il else 0)
+        o += b'\x2c' + struct.pack('<HHHHB', x, y, w, h, pk)
+        cbits = lct or gct_bits
+        if lct: o += bytes(rnd.randrange(256) for _ in range(3*(1 << lct)))
+        px = f['pixels']
+        if il:
+            rows = [px[r*w:(r+1)*w] for r in range(h)]
+            px = b''.join(rows[r] for r in interlace_rows(h))
+        mcs = max(2, cbits)
+        o += bytes([mcs]) + subblocks(lzw_encode(px, mcs), f.get('bs', bs))
+    o += b'\x3b'
+    open(path, 'wb').write(o)
+
+def pat(rnd, w, h, ncol, kind):
+    if kind == 'noise': return bytes(rnd.randrange(ncol) for _ in range(w*h))
+    if kind == 'flat': c = rnd.randrange(ncol); return bytes([c]*(w*h))
+    if kind == 'grad': return bytes(((x+y) * ncol // (w+h)) % ncol for y in range(h) for x in range(w))
+    if kind == 'sparse':
+        return bytes((rnd.randrange(1, ncol) if rnd.random() < 0.08 else 0) for _ in range(w*h))
+    if kind == 'blocks': return bytes(((x//4 + y//4) % 4) for y in range(h) for x in range(w))
+
+def gen(outdir):
+    rnd = random.Random(1)
+    K = ['noise', 'flat', 'grad', 'blocks', 'sparse']
+    def fr(W, H, n, bits=8, rects=False, disp=None, tr=False, lct=False, il=False, kinds=K, delay=None):
+        out = []
+        for i in range(n):
+            if rects and i:
+                w = rnd.randrange(1, W+1); h = rnd.randrange(1, H+1)
+                x = rnd.randrange(0, W-w+1); y = rnd.randrange(0, H-h+1)
+            else:
+                x, y, w, h = 0, 0, W, H
+            cb = (rnd.choice([2, 4, 8]) if lct and i % 2 else None)
+            nc = 1 << (cb or bits)
+            f = dict(rect=(x, y, w, h), pixels=pat(rnd, w, h, nc, kinds[i % len(kinds)]),
+                     disposal=(disp if disp is not None else rnd.randrange(4)),
+                     delay=(delay if delay is not None else rnd.choice([0, 2, 5, 10])))
+            if tr: f['transparent'] = 0
+            if cb: f['lct_bits'] = cb
+            if il: f['interlace'] = True
+            out.append(f)
+        return out
+    make_gif(f'{outdir}/small17.gif', 17, 17, fr(17, 17, 12, rects=True, tr=True), seed=1)
+    make_gif(f'{outdir}/small17_2col.gif', 17, 17, fr(17, 17, 8, bits=1, kinds=['noise', 'blocks']), gct_bits=1, seed=2, comment='two colours')
+    make_gif(f'{outdir}/hold17.gif', 17, 17, fr(17, 17, 6, disp=1, kinds=['flat', 'flat', 'grad', 'grad']), seed=3, bs=17)
+    make_gif(f'{outdir}/sparse17.gif', 17, 17, fr(17, 17, 10, tr=True, disp=1, kinds=['sparse']), seed=4)
+    make_gif(f'{outdir}/lct17.gif', 17, 17, fr(17, 17, 9, lct=True, rects=True), seed=5, plaintext=True)
+    make_gif(f'{outdir}/big64.gif', 64, 64, fr(64, 64, 6, rects=True, tr=True), seed=6, loop=3)
+    make_gif(f'{outdir}/big200.gif', 200, 120, fr(200, 120, 3, kinds=['noise', 'grad', 'blocks']), seed=7)
+    make_gif(f'{outdir}/interlaced17.gif', 17, 17, fr(17, 17, 8, il=True, rects=True), seed=8)
+    make_gif(f'{outdir}/interlaced64.gif', 64, 48, fr(64, 48, 5, il=True), seed=9, loop=2)
+    make_gif(f'{outdir}/restore17.gif', 17, 17, fr(17, 17, 10, disp=3, rects=True, tr=True), seed=10)
+    # the same frames with and without interlacing, for timing one against the other
+    frames = fr(200, 120, 3, kinds=['noise', 'grad', 'blocks'])
+    make_gif(f'{outdir}/lines200.gif', 200, 120, frames, seed=11)
+    make_gif(f'{outdir}/interlaced200.gif', 200, 120, [dict(f, interlace=True) for f in frames], seed=11)
+    make_gif(f'{outdir}/interlaced_rects64.gif', 64, 64, fr(64, 64, 12, il=True, rects=True, tr=True), seed=12)
+    # mostly transparent frames on top of each other, drawing them scales with the opaque pixels
+    make_gif(f'{outdir}/sparse200.gif', 200, 120, fr(200, 120, 6, tr=True, disp=1, kinds=['sparse']), seed=13)
+    # frames sticking out of the logical screen to the right and bottom, or starting outside it
+    frames = []
+    for i, (rect, kind, disp, il) in enumerate([((0, 0, 17, 17), 'noise', 1, False), ((8, 3, 14, 6), 'noise', 1, False),
+            ((0, 10, 30, 9), 'grad', 2, False), ((20, 4, 5, 5), 'noise', 1, False), ((3, 18, 6, 4), 'noise', 1, False),
+            ((5, 2, 20, 16), 'blocks', 3, True), ((12, 12, 10, 10), 'sparse', 1, False)]):
+        f = dict(rect=rect, pixels=pat(rnd, rect[2], rect[3], 256, kind), disposal=disp, delay=5, transparent=0)
+        if il: f['interlace'] = True
+        frames.append(f)
+    make_gif(f'{outdir}/offcanvas17.gif', 17, 17, frames, seed=14)
+    # frames with different or no transparent indices over colors that are another frame's one,
+    # disposed of so the whole canvas is drawn again
+    frames = []
+    for rect, kind, disp, tr in [((0, 0, 17, 17), 'blocks', 1, None), ((2, 2, 6, 6), 'sparse', 2, 3),
+            ((10, 10, 5, 5), 'noise', 1, 3), ((0, 0, 17, 8), 'grad', 2, 5), ((4, 9, 8, 8), 'noise', 3, 7),
+            ((1, 1, 10, 10), 'sparse', 1, None), ((6, 6, 9, 9), 'blocks', 2, 1), ((0, 0, 4, 4), 'noise', 1, None)]:
+        frames.append(dict(rect=rect, pixels=pat(rnd, rect[2], rect[3], 16, kind), disposal=disp, delay=5, transparent=tr))
+    make_gif(f'{outdir}/mixed17.gif', 17, 17, frames, gct_bits=4, seed=15)
+
+# Full frames of one kind each, from runs of a few colours to noise LZW can't compress
+def gen_lzw(outdir):
+    rnd = random.Random(2)
+    def fr(W, H, n, kind, bits=8):
+        return [dict(pixels=pat(rnd, W, H, 1 << bits, kind), disposal=1) for _ in range(n)]
+    make_gif(f'{outdir}/blocks480.gif', 480, 480, fr(480, 480, 3, 'blocks', 2), gct_bits=2, seed=20)
+    make_gif(f'{outdir}/flat480.gif', 480, 480, fr(480, 480, 2, 'flat'), seed=21)
+    make_gif(f'{outdir}/grad480.gif', 480, 480, fr(480, 480, 3, 'grad'), seed=22)
+    make_gif(f'{outdir}/noise256.gif', 256, 256, fr(256, 256, 4, 'noise'), seed=23)
+    make_gif(f'{outdir}/noise64_4bit.gif', 64, 64, fr(64, 64, 8, 'noise', 4), gct_bits=4, seed=24)
+    make_gif(f'{outdir}/sparse320.gif', 320, 240, fr(320, 240, 4, 'sparse', 4), gct_bits=4, seed=25)
+
+if __name__ == '__main__':
+    if sys.argv[1] == '--lzw':
+        gen_lzw(sys.argv[2])
+    else:
+        gen(sys.argv[1])
@@ -0,0 +1,212 @@
+// Checks and times the LZW kernel. Each gif is decoded from memory on a canvas of its own
+// size, up to MAX_CANVAS, so every pixel of every frame goes through LZW. The hash is
+// FNV-1a over every row the decoder draws, position and palette indices, for the first
+// loop. MB/s is the pixels of all frames of a loop over the fastest of the timed loops.
+// Built as lzwbench with the kernel in Mask_1.1/LzwDecoder_Impl.h and as lzwbench_ref
+// with the one it replaced in LzwReference_Impl.h, make lzw runs both on the same gifs
+// and fails unless they draw the same rows.
+//
+//   lzwbench [-n loops] [-g hashes.txt] [-u hashes.txt] file.gif...
+//     -n  loops timed per gif, 0 only hashes the first one [10]
+//     -g  compare the hashes with a file, exit status 1 on any difference
+//     -u  write the hashes to a file
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "GifDecoder.h"
+
+#define MAX_CANVAS        1024
+#define MAX_FRAMES        4096
+#define MAX_DECODE_CALLS  100000      // Gives up on a gif that never finishes a loop
+
+typedef std::chrono::steady_clock Clock;
+
+// Everything the callbacks need, passed as their user pointer
+typedef struct {
+  unsigned long time_ms;
+  bool hashing;
+  uint64_t hash;
+} Canvas;
+
+static void hashBytes(uint64_t & hash, const void * data, size_t size){
+  const uint8_t * bytes = (const uint8_t *)data;
+  for(size_t i = 0; i < size; i++){
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+}
+
+static unsigned long timeCallback(void * user){
+  return ((Canvas *)user)->time_ms;
+}
+
+static void drawRowCallback(void * user, int16_t x, int16_t y, const uint8_t * indices, int16_t width, const rgb_24 * palette, int16_t transparentIndex){
+  Canvas * canvas = (Canvas *)user;
+  if(!canvas->hashing){
+    return;
+  }
+  int16_t position[3] = { x, y, width };
+  hashBytes(canvas->hash, position, sizeof(position));
+  hashBytes(canvas->hash, indices, width);
+}
+
+// Decode one loop of the gif, frames are shown as soon as they are drawn
+static int decodeLoop(GifDecoder & decoder, Canvas & canvas){
+  for(int calls = 0; calls < MAX_DECODE_CALLS; calls++){
+    // the fake clock jumps to when the frame is due
+    canvas.time_ms += decoder.getTimeToNextFrame();
+    decoder.presentFrame();
+
+    int result = decoder.decodeFrame();
+    if(result == ERROR_DONE_PARSING){
+      decoder.presentFrame();
+      return ERROR_NONE;
+    }
+    if(result < 0){
+      return result;
+    }
+  }
+  return ERROR_BADGIFFORMAT;
+}
+
+static bool readFile(const char * path, std::vector<uint8_t> & data){
+  FILE * file = fopen(path, "rb");
+  if(!file){
+    return false;
+  }
+  fseek(file, 0, SEEK_END);
+  data.resize(ftell(file));
+  fseek(file, 0, SEEK_SET);
+  data.resize(fread(data.data(), 1, data.size(), file));
+  fclose(file);
+  return !data.empty();
+}
+
+static bool readHashes(const char * path, std::map<std::string, std::string> & hashes){
+  FILE * file = fopen(path, "r");
+  if(!file){
+    return false;
+  }
+  char name[1024], hash[64];
+  while(fscanf(file, "%1023s %63s", name, hash) == 2){
+    hashes[name] = hash;
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char ** argv){
+  int loops = 10;
+  const char * checkPath = NULL;
+  const char * updatePath = NULL;
+  std::vector<const char *> files;
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "-n") && i + 1 < argc){
+      loops = atoi(argv[++i]);
+    }else if(!strcmp(argv[i], "-g") && i + 1 < argc){
+      checkPath = argv[++i];
+    }else if(!strcmp(argv[i], "-u") && i + 1 < argc){
+      updatePath = argv[++i];
+    }else{
+      files.push_back(argv[i]);
+    }
+  }
+
+  std::map<std::string, std::string> hashes;
+  if(checkPath && !readHashes(checkPath, hashes)){
+    fprintf(stderr, "Can not read hashes: %s\n", checkPath);
+    return 1;
+  }
+  FILE * update = updatePath ? fopen(updatePath, "w") : NULL;
+  if(updatePath && !update){
+    fprintf(stderr, "Can not write hashes: %s\n", updatePath);
+    return 1;
+  }
+
+  // the decoder is large, keep it off the stack
+  GifDecoder * decoder = new GifDecoder(MAX_CANVAS, MAX_CANVAS);
+  std::vector<gif_frame_info> frameIndex(MAX_FRAMES);
+  std::vector<uint8_t> arena;
+
+  printf("%-40s %6s %9s %16s %8s\n", "gif", "frames", "Mpixels", "hash", "MB/s");
+  int failures = 0;
+  for(size_t f = 0; f < files.size(); f++){
+    std::vector<uint8_t> data;
+    Canvas canvas;
+    canvas.time_ms = 0;
+    canvas.hashing = true;
+    canvas.hash = 0xcbf29ce484222325ULL;
+
+    decoder->setCallbackUser(&canvas);
+    decoder->setDrawRowCallback(drawRowCallback);
+    decoder->setScaleMode(GIF_SCALE_NONE);
+    decoder->setFrameIndex(frameIndex.data(), MAX_FRAMES);
+    GifClock clock;
+    clock.setTimeCallback(timeCallback, &canvas);
+    decoder->setClock(&clock);
+
+    int result = ERROR_FILEOPEN;
+    if(readFile(files[f], data)){
+      decoder->setFileData(data.data(), data.size());
+      result = decoder->startDecoding();
+      if(result == ERROR_OUTOFMEMORY){
+        arena.resize(decoder->getArenaNeeded());
+        decoder->setArena(arena.data(), arena.size());
+        result = decoder->startDecoding();
+      }
+    }
+    if(result == ERROR_NONE){
+      result = decodeLoop(*decoder, canvas);
+    }
+    if(result < 0){
+      printf("%-40s error %i\n", files[f], result);
+      failures++;
+      continue;
+    }
+
+    long pixels = 0;
+    for(int i = 0; i < decoder->getFrameCount(); i++){
+      pixels += (long)frameIndex[i].width * frameIndex[i].height;
+    }
+
+    // the rest of the loops only decode
+    canvas.hashing = false;
+    double best_s = 0;
+    for(int loop = 0; loop < loops; loop++){
+      Clock::time_point start = Clock::now();
+      decodeLoop(*decoder, canvas);
+      std::chrono::duration<double> elapsed = Clock::now() - start;
+      if(loop == 0 || elapsed.count() < best_s){
+        best_s = elapsed.count();
+      }
+    }
+
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)canvas.hash);
+    bool ok = true;
+    if(checkPath){
+      std::map<std::string, std::string>::iterator itr = hashes.find(files[f]);
+      ok = itr != hashes.end() && itr->second == hash;
+    }
+    if(update){
+      fprintf(update, "%s %s\n", files[f], hash);
+    }
+    char speed[32] = "-";
+    if(loops > 0){
+      snprintf(speed, sizeof(speed), "%.1f", pixels / best_s / 1e6);
+    }
+    printf("%-40s %6i %9.3f %16s %8s%s\n", files[f], decoder->getFrameCount(), pixels / 1e6, hash, speed, ok ? "" : " DIFF");
+    if(!ok){
+      failures++;
+    }
+  }
+
+  if(update){
+    fclose(update);
+  }
+  delete decoder;
+  return failures ? 1 : 0;
+}
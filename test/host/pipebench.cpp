@@ -0,0 +1,214 @@
+// Times showing every frame of a gif after decoding it, the way loop() did, against
+// FramePipeline showing each frame on a thread while the next one is decoded. Showing
+// sleeps as long as FastLED.show() takes, the leds are clocked out by hardware and the
+// cpu is free meanwhile. Each gif is decoded for the mask and frames are shown as fast
+// as they can be, the pipeline has to show every one of them.
+//
+//   pipebench [-n frames] [-s show_us] [-c] file.gif...
+//     -n  frames shown per gif and way [200]
+//     -s  time a show takes in us, 0 for the time decoding a frame takes [0]
+//     -c  exit status 1 unless the pipeline saves at least half of the faster of decoding
+//         and showing per frame, all of it would be max(decode, show) per frame. Waking up
+//         a thread takes ~50 us on a host, gifs that decode faster can't pass.
+//
+// Built with GIF_STATS 1 (make stats) the stage times of showing after each decode are
+// printed for every gif as well, see GifStats.h.
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "FramePipeline.h"
+#include "GifDecoder.h"
+
+#define FRAME_SIZE       (17 * 17 * 3)
+#define MIN_OVERLAP      0.5          // Share of min(decode, show) the pipeline has to save per frame with -c
+
+typedef std::chrono::steady_clock Clock;
+
+// Everything the callbacks need, passed as their user pointer
+typedef struct {
+  uint8_t rgb[FRAME_SIZE];
+  unsigned long time_ms;
+  long show_us;
+  FramePipeline * pipeline;
+  int shows;
+#if GIF_STATS
+  GifStats * stats;
+#endif
+} Canvas;
+
+static void screenClearCallback(void * user){
+  memset(((Canvas *)user)->rgb, 0, FRAME_SIZE);
+}
+
+static unsigned long timeCallback(void * user){
+  return ((Canvas *)user)->time_ms;
+}
+
+static void drawRowCallback(void * user, int16_t x, int16_t y, const uint8_t * indices, int16_t width, const rgb_24 * palette, int16_t transparentIndex){
+  Canvas * canvas = (Canvas *)user;
+  if(y >= 17 || x >= 17){
+    return;
+  }
+  width = min(width, 17 - x);
+  uint8_t * out = &canvas->rgb[3 * (y * 17 + x)];
+  for(int i = 0; i < width; i++, out += 3){
+    if(indices[i] != transparentIndex){
+      out[0] = palette[indices[i]].red;
+      out[1] = palette[indices[i]].green;
+      out[2] = palette[indices[i]].blue;
+    }
+  }
+}
+
+static void showFrame(void * user, const uint8_t * frame){
+  std::this_thread::sleep_for(std::chrono::microseconds(((Canvas *)user)->show_us));
+}
+
+// A frame is shown once the decoder presents it, through the pipeline when there is one.
+// The pipeline gets the next frame once the last one is on its way, none is dropped.
+static void updateScreenCallback(void * user){
+  Canvas * canvas = (Canvas *)user;
+  canvas->shows++;
+  if(!canvas->pipeline){
+    GIF_STATS_ENTER(canvas->stats, GIF_STAGE_SHOW);
+    showFrame(canvas, canvas->rgb);
+    GIF_STATS_END_FRAME(canvas->stats);
+    return;
+  }
+  while(canvas->pipeline->isFramePending()){
+    std::this_thread::yield();
+  }
+  canvas->pipeline->present(canvas->rgb);
+}
+
+// Decode and show frames until there were count shows, ms per frame
+static double playFrames(GifDecoder & decoder, Canvas & canvas, int count){
+  canvas.shows = 0;
+  Clock::time_point start = Clock::now();
+  while(canvas.shows < count){
+    // the fake clock jumps to when the frame is due
+    canvas.time_ms += decoder.getTimeToNextFrame();
+    decoder.presentFrame();
+    int result = decoder.decodeFrame();
+    if(result == ERROR_DONE_PARSING){
+      decoder.presentFrame();
+      decoder.startDecoding();
+    }else if(result < 0){
+      return -1;
+    }
+  }
+  // the last frames are only done once the show thread showed them
+  while(canvas.pipeline && canvas.pipeline->getShownFrames() < (unsigned long)count){
+    std::this_thread::yield();
+  }
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+  return elapsed.count() / count;
+}
+
+int main(int argc, char ** argv){
+  int frames = 200;
+  long show_us = 0;
+  bool check = false;
+  std::vector<const char *> files;
+  for(int i = 1; i < argc; i++){
+    if(!strcmp(argv[i], "-n") && i + 1 < argc){
+      frames = atoi(argv[++i]);
+    }else if(!strcmp(argv[i], "-s") && i + 1 < argc){
+      show_us = atol(argv[++i]);
+    }else if(!strcmp(argv[i], "-c")){
+      check = true;
+    }else{
+      files.push_back(argv[i]);
+    }
+  }
+
+  printf("%-40s %9s %9s %9s %9s %9s %7s\n", "gif", "ms/decode", "ms/show", "ms/serial", "ms/pipe", "ms/max", "overlap");
+  int failures = 0;
+  for(size_t f = 0; f < files.size(); f++){
+    std::vector<uint8_t> data;
+    FILE * file = fopen(files[f], "rb");
+    if(file){
+      fseek(file, 0, SEEK_END);
+      data.resize(ftell(file));
+      fseek(file, 0, SEEK_SET);
+      data.resize(fread(data.data(), 1, data.size(), file));
+      fclose(file);
+    }
+
+    Canvas canvas;
+    memset(canvas.rgb, 0, FRAME_SIZE);
+    canvas.time_ms = 0;
+    canvas.show_us = 0;
+    canvas.pipeline = NULL;
+#if GIF_STATS
+    GifStats stats;
+    canvas.stats = NULL;
+#endif
+
+    GifDecoder decoder(17, 17);
+    decoder.setCallbackUser(&canvas);
+    decoder.setScreenClearCallback(screenClearCallback);
+    decoder.setUpdateScreenCallback(updateScreenCallback);
+    decoder.setDrawRowCallback(drawRowCallback);
+    decoder.setFileData(data.data(), data.size());
+    decoder.setScaleMode(GIF_SCALE_BOX);
+    GifClock clock;
+    clock.setTimeCallback(timeCallback, &canvas);
+    decoder.setClock(&clock);
+
+    std::vector<uint8_t> arena;
+    int result = data.empty() ? ERROR_FILEOPEN : decoder.startDecoding();
+    if(result == ERROR_OUTOFMEMORY){
+      arena.resize(decoder.getArenaNeeded());
+      decoder.setArena(arena.data(), arena.size());
+      result = decoder.startDecoding();
+    }
+
+    // decoding alone, then showing after each decode and through the pipeline
+    double decode_ms = result < 0 ? -1 : playFrames(decoder, canvas, frames);
+    if(decode_ms < 0){
+      printf("%-40s error %i\n", files[f], result);
+      failures++;
+      continue;
+    }
+    canvas.show_us = show_us ? show_us : (long)(decode_ms * 1000 + 0.5);
+#if GIF_STATS
+    canvas.stats = &stats;
+    decoder.setStats(&stats);
+#endif
+    double serial_ms = playFrames(decoder, canvas, frames);
+#if GIF_STATS
+    canvas.stats = NULL;
+    decoder.setStats(NULL);
+#endif
+
+    FramePipeline pipeline(FRAME_SIZE);
+    pipeline.setShowCallback(showFrame, &canvas);
+    pipeline.begin();
+    canvas.pipeline = &pipeline;
+    double pipe_ms = playFrames(decoder, canvas, frames);
+    pipeline.end();
+
+    double show_ms = canvas.show_us / 1000.0;
+    double max_ms = std::max(decode_ms, show_ms);
+    double overlap = (serial_ms - pipe_ms) / min(decode_ms, show_ms);
+    bool ok = pipeline.getShownFrames() == (unsigned long)frames && pipeline.getDroppedFrames() == 0;
+    if(check && overlap < MIN_OVERLAP){
+      ok = false;
+    }
+    printf("%-40s %9.3f %9.3f %9.3f %9.3f %9.3f %6.0f%%%s\n", files[f], decode_ms, show_ms, serial_ms,
+      pipe_ms, max_ms, overlap * 100, ok ? "" : " FAIL");
+#if GIF_STATS
+    Serial.out = stdout;
+    stats.print();
+    Serial.out = NULL;
+#endif
+    if(!ok){
+      failures++;
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+// Just enough Arduino for GifDecoder on a Linux host
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+
+using std::max;
+
+#define DEC 10
+#define HEX 16
+
+// Arduino's String, only what the sketch uses
+class String : public std::string{
+
+public:
+
+    String(){}
+    String(const char * s) : std::string(s ? s : ""){}
+    String(const std::string & s) : std::string(s){}
+    bool endsWith(const String & s) const { return size() >= s.size() && compare(size() - s.size(), s.size(), s) == 0; }
+    bool startsWith(const String & s) const { return compare(0, s.size(), s) == 0; }
+};
+
+inline String operator+(const String & a, const String & b){ return String(std::string(a) + std::string(b)); }
+inline String operator+(const String & a, const char * b){ return String(std::string(a) + b); }
+inline String operator+(const char * a, const String & b){ return String(a + std::string(b)); }
+
+// Serial prints go nowhere unless out is set, e.g. to stderr
+class HostSerial{
+
+public:
+
+    void print(const char * s){ if(out) fputs(s, out); }
+    void print(char c){ if(out) fputc(c, out); }
+    void print(long n, int base = DEC){ if(out) fprintf(out, base == HEX ? "%lx" : "%ld", n); }
+    void print(int n, int base = DEC){ print((long)n, base); }
+    void print(unsigned long n, int base = DEC){ if(out) fprintf(out, base == HEX ? "%lx" : "%lu", n); }
+    void print(unsigned int n, int base = DEC){ print((unsigned long)n, base); }
+    void print(unsigned char n, int base = DEC){ print((unsigned long)n, base); }
+    void print(double n){ if(out) fprintf(out, "%.2f", n); }
+    void print(const String & s){ print(s.c_str()); }
+    template<class T> void println(T value){ print(value); println(); }
+    template<class T> void println(T value, int base){ print(value, base); println(); }
+    void println(){ if(out) fputc('\n', out); }
+    void printf(const char * format, ...){
+      if(!out) return;
+      va_list args;
+      va_start(args, format);
+      vfprintf(out, format, args);
+      va_end(args);
+    }
+    int read(){ return -1; }
+
+    FILE * out = NULL;
+};
+
+static HostSerial Serial;
+
+// Time only moves when the host program moves it, which keeps runs deterministic
+static unsigned long hostMillis = 0;
+
+inline unsigned long millis(){
+  return hostMillis;
+}
+
+// A cycle is a ns of the host's clock
+class HostESP{
+
+public:
+
+    uint32_t getCycleCount(){
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return (uint32_t)now.tv_sec * 1000000000u + (uint32_t)now.tv_nsec;
+    }
+};
+
+static HostESP ESP __attribute__((unused));
@@ -0,0 +1,94 @@
+#pragma once
+// Just enough FastLED for GifPlayer and Compositor on a Linux host, nothing is shown
+
+#include "Arduino.h"
+
+typedef uint8_t byte;
+
+struct CRGB{
+
+    union{
+      struct{ uint8_t r, g, b; };
+      uint8_t raw[3];
+    };
+
+    CRGB() : r(0), g(0), b(0){}
+    CRGB(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b){}
+    CRGB(uint32_t color) : r(color >> 16), g(color >> 8), b(color){}
+    bool operator==(const CRGB & other) const { return r == other.r && g == other.g && b == other.b; }
+    bool operator!=(const CRGB & other) const { return !(*this == other); }
+};
+
+// Byte order of the leds, octal digits like FastLED
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+enum { WS2811, WS2812B, NEOPIXEL };
+
+#define TypicalSMD5050    0xFFB0F0
+#define TypicalLEDStrip   0xFFB0F0
+#define UncorrectedColor  0xFFFFFF
+#define DISABLE_DITHER    0
+#define BINARY_DITHER     1
+
+inline uint8_t scale8(uint8_t i, uint8_t scale){ return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8; }
+inline uint8_t qadd8(uint8_t a, uint8_t b){ unsigned sum = a + b; return sum > 255 ? 255 : sum; }
+inline uint8_t qsub8(uint8_t a, uint8_t b){ return a > b ? a - b : 0; }
+inline int16_t sin16(uint16_t theta){ return 32767.0 * sin(theta * 2 * M_PI / 65536.0); }
+inline int16_t cos16(uint16_t theta){ return sin16(theta + 16384); }
+
+// Hue in six even sections, close enough to FastLED's rainbow for timing
+struct CHSV{
+
+    uint8_t h, s, v;
+
+    CHSV(uint8_t h, uint8_t s, uint8_t v) : h(h), s(s), v(v){}
+    operator CRGB() const {
+      int section = h / 43;
+      int rise = (h % 43) * 6;
+      uint8_t low = scale8(v, 255 - s);
+      uint8_t up = low + (v - low) * rise / 255;
+      uint8_t down = v - (v - low) * rise / 255;
+      switch(section){
+        case 0: return CRGB(v, up, low);
+        case 1: return CRGB(down, v, low);
+        case 2: return CRGB(low, v, up);
+        case 3: return CRGB(low, down, v);
+        case 4: return CRGB(up, low, v);
+        default: return CRGB(v, low, down);
+      }
+    }
+};
+
+class CLEDController{
+
+public:
+
+    CLEDController & setCorrection(uint32_t correction){ return *this; }
+};
+
+// show() only counts, the leds are left as they are
+class CFastLED{
+
+public:
+
+    template<int CHIPSET, int PIN, EOrder ORDER> CLEDController & addLeds(CRGB * leds, int count){
+      this->leds = leds;
+      this->count = count;
+      return controller;
+    }
+    void setBrightness(uint8_t value){ brightness = value; }
+    uint8_t getBrightness(){ return brightness; }
+    void setDither(uint8_t dither){}
+    void clear(bool show = false){
+      memset((void *)leds, 0, count * sizeof(CRGB));
+      if(show) this->show();
+    }
+    void show(){ shows++; }
+
+    CLEDController controller;
+    CRGB * leds = NULL;
+    int count = 0;
+    uint8_t brightness = 255;
+    unsigned long shows = 0;
+};
+
+static CFastLED FastLED __attribute__((unused));
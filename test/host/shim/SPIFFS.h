@@ -0,0 +1,103 @@
+#pragma once
+// SPIFFS on a directory of the host, just enough for GifPlayer. Paths start at spiffsRoot,
+// which the host program sets before anything is opened.
+
+#include "Arduino.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+
+static std::string spiffsRoot = ".";
+
+// Shared handle like Arduino's File, copies refer to the same open file
+class File{
+
+public:
+
+    struct Handle{
+      ~Handle(){ if(file) fclose(file); }
+      FILE * file = NULL;
+      std::string path;
+      bool directory = false;
+      std::vector<std::string> entries;
+      size_t nextEntry = 0;
+    };
+
+    File(){}
+    File(std::shared_ptr<Handle> handle) : handle(handle){}
+
+    operator bool() const { return handle && (handle->file || handle->directory); }
+    const char * name(){ return handle ? handle->path.c_str() : ""; }
+    bool isDirectory(){ return handle && handle->directory; }
+    size_t read(uint8_t * buffer, size_t size){ return isFile() ? fread(buffer, 1, size, handle->file) : 0; }
+    int read(){ return isFile() ? fgetc(handle->file) : -1; }
+    size_t write(const uint8_t * buffer, size_t size){ return isFile() ? fwrite(buffer, 1, size, handle->file) : 0; }
+    bool seek(uint32_t position){ return isFile() && fseek(handle->file, position, SEEK_SET) == 0; }
+    size_t position(){ return isFile() ? ftell(handle->file) : 0; }
+    size_t size(){
+      struct stat info;
+      return (isFile() && fstat(fileno(handle->file), &info) == 0) ? info.st_size : 0;
+    }
+    void close(){
+      if(isFile()){
+        fclose(handle->file);
+        handle->file = NULL;
+      }
+      if(handle) handle->directory = false;
+    }
+    File openNextFile();
+
+private:
+
+    bool isFile(){ return handle && handle->file; }
+
+    std::shared_ptr<Handle> handle;
+};
+
+class SPIFFSClass{
+
+public:
+
+    bool begin(bool formatOnFail = false){ return true; }
+
+    File open(const String & path, const char * mode = "r"){
+      std::shared_ptr<File::Handle> handle(new File::Handle());
+      handle->path = path;
+      std::string hostPath = spiffsRoot + std::string(path);
+      struct stat info;
+      if(mode[0] == 'r' && stat(hostPath.c_str(), &info) == 0 && S_ISDIR(info.st_mode)){
+        DIR * dir = opendir(hostPath.c_str());
+        struct dirent * entry;
+        while(dir && (entry = readdir(dir))){
+          if(entry->d_name[0] != '.') handle->entries.push_back(path + "/" + entry->d_name);
+        }
+        if(dir) closedir(dir);
+        std::sort(handle->entries.begin(), handle->entries.end());
+        handle->directory = true;
+      }else{
+        handle->file = fopen(hostPath.c_str(), mode[0] == 'w' ? "wb" : (mode[0] == 'a' ? "ab" : "rb"));
+      }
+      return File(handle);
+    }
+
+    bool exists(const String & path){
+      struct stat info;
+      return stat((spiffsRoot + std::string(path)).c_str(), &info) == 0;
+    }
+
+    bool remove(const String & path){
+      return unlink((spiffsRoot + std::string(path)).c_str()) == 0;
+    }
+};
+
+static SPIFFSClass SPIFFS __attribute__((unused));
+
+// Entries of a directory in name order
+inline File File::openNextFile(){
+  if(!handle || handle->nextEntry >= handle->entries.size()){
+    return File();
+  }
+  return SPIFFS.open(String(handle->entries[handle->nextEntry++]));
+}